@@ -1,4 +1,6 @@
-gcc -o MIMM\MIMM.exe main.c bmp.c linkedList.c quad.c windowUtil.c display.c -lgdi32
+gcc -o genPalettes.exe genPalettes.c && genPalettes.exe builtinPalettes.c MIMM\colorKeys\blackWhite.csv MIMM\colorKeys\grayscale.csv MIMM\colorKeys\sepia.csv MIMM\colorKeys\wool.csv MIMM\colorKeys\all.csv
+gcc -o MIMM\MIMM.exe main.c bmp.c linkedList.c quad.c commands.c parallel.c tune.c grid.c bitboard.c palette.c builtinPalettes.c delta.c sequence.c search.c clone.c requantize.c daemon.c chunks.c progressive.c reduce.c cache.c job.c mapitem.c session.c tolerance.c components.c windowUtil.c display.c -lgdi32 -lws2_32
+gcc -shared -DMIMM_BUILD -o MIMM\mimm.dll mimm.c bmp.c linkedList.c quad.c commands.c parallel.c tune.c grid.c bitboard.c palette.c builtinPalettes.c requantize.c tolerance.c delta.c job.c
 cd MIMM
 start MIMM.exe
 PAUSE
\ No newline at end of file
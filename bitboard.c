@@ -0,0 +1,378 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: bitboard.c
+
+Note: The bitboard optimizer. Every color gets one row of bits for every row of cells, a cell being one square of the level of detail.
+Like the linked list optimizer it replaces, colors are extracted one at a time in priority order.
+While a color is being extracted, the cells of every color that has not been extracted yet are 'remaining'. Those will be
+placed over later, so a fill of the current color may run over them. Each run of remaining cells in a row that holds the color
+gives one span, from the first to the last cell of the color in that run.
+Going down the rows, a span is merged into a rectangle from the row above when the rectangle and the span both fit inside
+the runs of every row the rectangle covers. A rectangle also carries on through a run that holds none of the color, so it can reach
+more of the color further down. Any rows at the bottom that were only carried through are trimmed off when it closes.
+Finding runs, spans and taking a color out of the remaining cells are all done on whole words of bits at a time.
+GRID_EMPTY cells are in no color, but always remaining, so rectangles grow through them freely.
+The rows of a color can not be split between threads, since every row carries on the rectangles of the row above it. The colors can be:
+what is remaining for a color only depends on which colors come before it in the order, so every color's remaining cells are worked out
+first and the colors are then extracted in parallel into lists of their own. Joining the lists in order gives exactly the serial plan.
+Filling the bits of a tall grid is split into bands of rows.
+
+Timeline:
+20261019 - File created.
+20261019 - Colors are extracted in parallel and tall grids are filled in bands of rows.
+20261019 - Colors left to extract are skipped once the current job is cancelled. Progress is reported color by color.
+*/
+
+#include <windows.h>
+#include <string.h>
+#include "bitboard.h"
+#include "commands.h"
+#include "job.h"
+#include "parallel.h"
+
+struct Rectangle {
+    int startRow;
+    int lastRow; /* Last row that actually held the color. */
+    int startCol;
+    int endCol;
+    int low; /* The columns the rectangle may still grow to. */
+    int high;
+};
+
+struct BitboardFill {
+    struct Bitboard *b;
+    struct Grid *grid;
+};
+
+void fillBitboardRows(void *context, int band) {
+    struct BitboardFill *f = context;
+    struct Bitboard *b = f->b;
+    int i, j, cell = b->cell, last = (band + 1) * BITBOARD_BAND;
+
+    if(last > b->height)
+        last = b->height;
+    for(i = band * BITBOARD_BAND ; i < last ; i++)
+        for(j = 0 ; j < b->width ; j++) {
+            int color = b->transposed ? GRID(f->grid, j * cell, i * cell):GRID(f->grid, i * cell, j * cell);
+            if(color < b->colors)
+                BITBOARD_ROW(b, color, i)[j >> 6] |= (uint64_t)1 << (j & 63);
+            b->all[i * b->words + (j >> 6)] |= (uint64_t)1 << (j & 63);
+        }
+}
+
+struct Bitboard* allocBitboard(struct Grid *grid, int colors, int cell, int transposed) {
+    struct Bitboard *b = malloc(sizeof(struct Bitboard));
+    struct BitboardFill f;
+    int i, bands, width = grid->width / cell, height = grid->height / cell;
+
+    b->colors = colors;
+    b->cell = cell;
+    b->transposed = transposed;
+    b->width = transposed ? height:width;
+    b->height = transposed ? width:height;
+    b->words = (b->width + 63) / 64;
+    b->bits = calloc((size_t)colors * b->height * b->words, sizeof(uint64_t));
+    b->all = calloc((size_t)b->height * b->words, sizeof(uint64_t));
+
+    f.b = b;
+    f.grid = grid;
+    bands = (b->height + BITBOARD_BAND - 1) / BITBOARD_BAND;
+    if(b->width * b->height >= BITBOARD_PARALLEL_CELLS) /* Every row has words of its own, so bands never write to the same word. */
+        parallelFor(bands, fillBitboardRows, &f);
+    else
+        for(i = 0 ; i < bands ; i++)
+            fillBitboardRows(&f, i);
+
+    return b;
+}
+
+void freeBitboard(struct Bitboard *b) {
+    free(b->bits);
+    free(b->all);
+    free(b);
+}
+
+int nextSet(uint64_t *row, int words, int from) { /* First set bit at or after 'from', or words * 64 when there is none. */
+    int w = from >> 6;
+    uint64_t bits;
+
+    if(w >= words)
+        return words * 64;
+    bits = row[w] & (~(uint64_t)0 << (from & 63));
+    while(bits == 0) {
+        if(++w >= words)
+            return words * 64;
+        bits = row[w];
+    }
+    return (w << 6) + __builtin_ctzll(bits);
+}
+
+int nextClear(uint64_t *row, int words, int from) { /* First clear bit at or after 'from'. */
+    int w = from >> 6;
+    uint64_t bits;
+
+    if(w >= words)
+        return words * 64;
+    bits = ~row[w] & (~(uint64_t)0 << (from & 63));
+    while(bits == 0) {
+        if(++w >= words)
+            return words * 64;
+        bits = ~row[w];
+    }
+    return (w << 6) + __builtin_ctzll(bits);
+}
+
+int prevSet(uint64_t *row, int from) { /* Last set bit at or before 'from', or -1 when there is none. */
+    int w = from >> 6;
+    uint64_t bits;
+
+    if(from < 0)
+        return -1;
+    bits = row[w] & (~(uint64_t)0 >> (63 - (from & 63)));
+    while(bits == 0) {
+        if(--w < 0)
+            return -1;
+        bits = row[w];
+    }
+    return (w << 6) + 63 - __builtin_clzll(bits);
+}
+
+void bitboardBreaks(struct Bitboard *b, int *counters) { /* Counts the runs of every color across every row and down every column, the same 'breaks' mergeCommands counted. */
+    int c, i, w;
+
+    for(c = 0 ; c < b->colors ; c++) {
+        counters[c] = 0;
+        for(i = 0 ; i < b->height ; i++) {
+            uint64_t *row = BITBOARD_ROW(b, c, i), carry = 0;
+            for(w = 0 ; w < b->words ; w++) {
+                counters[c] += __builtin_popcountll(row[w] & ~((row[w] << 1) | carry)); /* Cells whose left neighbor is another color. */
+                carry = row[w] >> 63;
+                if(i > 0)
+                    counters[c] += __builtin_popcountll(row[w] & ~row[w - b->words]); /* Cells whose upper neighbor is another color. */
+                else
+                    counters[c] += __builtin_popcountll(row[w]);
+            }
+        }
+    }
+}
+
+int bitboardArea(struct Bitboard *b, int color) {
+    int i, area = 0, rows = b->height * b->words;
+    uint64_t *row = BITBOARD_ROW(b, color, 0);
+    for(i = 0 ; i < rows ; i++)
+        area += __builtin_popcountll(row[i]);
+    return area;
+}
+
+int bitboardOrder(struct Bitboard *b, int *order) { /* The priority order optimizeCommands has always used, most breaks first. */
+    int n, *counters = malloc(b->colors * sizeof(int));
+    bitboardBreaks(b, counters);
+    n = priorityOrder(counters, b->colors, order);
+    free(counters);
+    return n;
+}
+
+void closeRectangle(struct Bitboard *b, struct Rectangle *r, int color, struct LinkedList *plan) {
+    int cell = b->cell;
+    if(plan == NULL)
+        return;
+    if(b->transposed)
+        LL_append(plan, allocMarker(r->startRow * cell, r->startCol * cell, (r->lastRow + 1) * cell - 1, (r->endCol + 1) * cell - 1, color));
+    else
+        LL_append(plan, allocMarker(r->startCol * cell, r->startRow * cell, (r->endCol + 1) * cell - 1, (r->lastRow + 1) * cell - 1, color));
+}
+
+struct RectangleList {
+    struct Rectangle *items;
+    int n;
+    int capacity;
+};
+
+void pushRectangle(struct RectangleList *list, struct Rectangle *r) {
+    if(list->n == list->capacity) {
+        list->capacity *= 2;
+        list->items = realloc(list->items, list->capacity * sizeof(struct Rectangle));
+    }
+    list->items[list->n++] = *r;
+}
+
+void sortRectangles(struct Rectangle *open, int n) { /* Insertion sort by start column, most rows are already in order. */
+    int i, j;
+    struct Rectangle r;
+    for(i = 1 ; i < n ; i++) {
+        r = open[i];
+        for(j = i - 1 ; j >= 0 && open[j].startCol > r.startCol ; j--)
+            open[j + 1] = open[j];
+        open[j + 1] = r;
+    }
+}
+
+int extractBitColor(struct Bitboard *b, uint64_t *remaining, int color, struct RectangleList *open, struct RectangleList *next, struct LinkedList *plan) {
+    int i, o, count = 0, limit = b->words * 64;
+    struct RectangleList swap;
+
+    open->n = 0;
+    for(i = 0 ; i < b->height ; i++) {
+        uint64_t *runs = remaining + i * b->words, *row = BITBOARD_ROW(b, color, i);
+        int low = nextSet(runs, b->words, 0);
+        o = 0;
+        next->n = 0;
+
+        while(low < limit) {
+            int high = nextClear(runs, b->words, low) - 1, spanStart = nextSet(row, b->words, low), spanEnd = -1, merged = 0;
+            if(spanStart <= high)
+                spanEnd = prevSet(row, high);
+
+            while(o < open->n && open->items[o].startCol <= high) {
+                struct Rectangle *r = &open->items[o++];
+                if(r->startCol < low || r->endCol > high) { /* The run does not hold the rectangle, so it ends on the row above. */
+                    closeRectangle(b, r, color, plan);
+                    count++;
+                    continue;
+                }
+                if(r->low < low)
+                    r->low = low;
+                if(r->high > high)
+                    r->high = high;
+                if(!merged && spanEnd >= 0) {
+                    int startCol = spanStart < r->startCol ? spanStart:r->startCol, endCol = spanEnd > r->endCol ? spanEnd:r->endCol;
+                    if(startCol >= r->low && endCol <= r->high) { /* The span fits, so it joins the rectangle. */
+                        r->startCol = startCol;
+                        r->endCol = endCol;
+                        r->lastRow = i;
+                        merged = 1;
+                    }
+                }
+                pushRectangle(next, r);
+            }
+
+            if(!merged && spanEnd >= 0) { /* Nothing above could take the span, so it starts a rectangle of its own. */
+                struct Rectangle r;
+                r.startRow = i;
+                r.lastRow = i;
+                r.startCol = spanStart;
+                r.endCol = spanEnd;
+                r.low = low;
+                r.high = high;
+                pushRectangle(next, &r);
+            }
+
+            low = nextSet(runs, b->words, high + 1);
+        }
+
+        for( ; o < open->n ; o++) { /* Past the last run, nothing can carry on. */
+            closeRectangle(b, &open->items[o], color, plan);
+            count++;
+        }
+
+        sortRectangles(next->items, next->n);
+        swap = *open;
+        *open = *next;
+        *next = swap;
+    }
+
+    for(o = 0 ; o < open->n ; o++) {
+        closeRectangle(b, &open->items[o], color, plan);
+        count++;
+    }
+
+    for(i = 0 ; i < b->height * b->words ; i++) /* The color is placed, so its cells are no longer remaining. */
+        remaining[i] &= ~BITBOARD_ROW(b, color, 0)[i];
+
+    return count;
+}
+
+int bitboardCommands(struct Bitboard *b, int *order, int n, struct LinkedList *plan) { /* Appends the rectangles to 'plan' and returns how many there are. With no plan it only counts. */
+    int i, count = 0;
+    uint64_t *remaining = malloc((size_t)b->height * b->words * sizeof(uint64_t));
+    struct RectangleList open, next;
+
+    open.capacity = next.capacity = b->width + 1;
+    open.items = malloc(open.capacity * sizeof(struct Rectangle));
+    next.items = malloc(next.capacity * sizeof(struct Rectangle));
+
+    memcpy(remaining, b->all, (size_t)b->height * b->words * sizeof(uint64_t));
+    for(i = 0 ; i < n && !jobCancelled() ; i++) {
+        count += extractBitColor(b, remaining, order[i], &open, &next, plan);
+        if(plan != NULL) /* Counting is what the search does thousands of times, it is not worth reporting. */
+            reportProgress(JOB_OPTIMIZE, i + 1, n);
+    }
+
+    free(open.items);
+    free(next.items);
+    free(remaining);
+    return count;
+}
+
+struct ColorJobs {
+    struct Bitboard *b;
+    int *order;
+    uint64_t *remaining; /* The remaining cells of every color in the order, one after another. */
+    struct LinkedList *plans; /* NULL when only counting. */
+    int *counts;
+    int n;
+    volatile LONG done; /* Colors extracted so far, for the progress. */
+};
+
+void extractColorJob(void *context, int job) {
+    struct ColorJobs *c = context;
+    struct Bitboard *b = c->b;
+    struct RectangleList open, next;
+
+    c->counts[job] = 0;
+    if(jobCancelled())
+        return;
+
+    open.capacity = next.capacity = b->width + 1;
+    open.items = malloc(open.capacity * sizeof(struct Rectangle));
+    next.items = malloc(next.capacity * sizeof(struct Rectangle));
+
+    c->counts[job] = extractBitColor(b, c->remaining + (size_t)job * b->height * b->words, c->order[job], &open, &next, c->plans == NULL ? NULL:&c->plans[job]);
+    if(c->plans != NULL)
+        reportProgress(JOB_OPTIMIZE, InterlockedIncrement(&c->done), c->n);
+
+    free(open.items);
+    free(next.items);
+}
+
+int bitboardCommandsParallel(struct Bitboard *b, int *order, int n, struct LinkedList *plan) { /* Same rectangles in the same order as bitboardCommands. */
+    int i, k, count = 0, size = b->height * b->words;
+    struct ColorJobs c;
+
+    if(n < 2)
+        return bitboardCommands(b, order, n, plan);
+
+    c.b = b;
+    c.order = order;
+    c.remaining = malloc((size_t)n * size * sizeof(uint64_t));
+    c.plans = plan == NULL ? NULL:calloc(n, sizeof(struct LinkedList));
+    c.counts = malloc(n * sizeof(int));
+    c.n = n;
+    c.done = 0;
+
+    memcpy(c.remaining, b->all, (size_t)size * sizeof(uint64_t));
+    for(k = 1 ; k < n ; k++) { /* What is left for a color is what was left for the one before it, less that color. */
+        uint64_t *before = c.remaining + (size_t)(k - 1) * size, *after = before + size, *placed = BITBOARD_ROW(b, order[k - 1], 0);
+        for(i = 0 ; i < size ; i++)
+            after[i] = before[i] & ~placed[i];
+    }
+
+    parallelFor(n, extractColorJob, &c);
+
+    for(k = 0 ; k < n ; k++) {
+        count += c.counts[k];
+        if(plan == NULL || c.plans[k].head == NULL)
+            continue;
+        if(plan->head == NULL)
+            plan->head = c.plans[k].head;
+        else
+            plan->tail->next = c.plans[k].head;
+        plan->tail = c.plans[k].tail;
+    }
+
+    free(c.remaining);
+    free(c.plans);
+    free(c.counts);
+    return count;
+}
@@ -0,0 +1,42 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: bitboard.h
+
+Timeline:
+20261019 - File created.
+20261019 - Parallel extraction and filling.
+*/
+
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+#include "grid.h"
+#include "linkedList.h"
+
+struct Bitboard { /* One row of bits per color per row of cells. */
+    int colors;
+    int width; /* Cells across. */
+    int height; /* Cells down. */
+    int words; /* 64 bit words per row. */
+    int cell; /* Pixels across one cell, this is the level of detail. */
+    int transposed; /* The rows of the board are the columns of the grid. */
+    uint64_t *bits; /* bits[(color * height + row) * words + word] */
+    uint64_t *all; /* Every cell of every row, GRID_EMPTY cells included. */
+};
+
+#define BITBOARD_BAND 64 /* Rows filled by one job when a tall grid is filled in parallel. */
+#define BITBOARD_PARALLEL_CELLS (512 * 512) /* Grids with fewer cells than this are filled on one thread, starting threads would cost more. */
+
+#define BITBOARD_ROW(b, color, row) ((b)->bits + ((color) * (b)->height + (row)) * (b)->words)
+
+struct Bitboard* allocBitboard(struct Grid *grid, int colors, int cell, int transposed);
+void freeBitboard(struct Bitboard *b);
+void bitboardBreaks(struct Bitboard *b, int *counters);
+int bitboardArea(struct Bitboard *b, int color);
+int bitboardOrder(struct Bitboard *b, int *order);
+int bitboardCommands(struct Bitboard *b, int *order, int n, struct LinkedList *plan);
+int bitboardCommandsParallel(struct Bitboard *b, int *order, int n, struct LinkedList *plan);
+
+#endif
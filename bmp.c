@@ -6,6 +6,7 @@ File: bmp.c
 === Timeline ===
 20240801 - File created.
 20240810 - Added option to handle images with transparency data.
+20261019 - readPixel keeps the alpha byte in the top byte of the pixel instead of tossing it.
 
 === Notes ===
 Used this webpage for information and help on the BMP structure:
@@ -47,13 +48,15 @@ struct RGBColor readRGB(FILE *fr, int transparency) {
     return rgb;
 }
 
-uint32_t readPixel(FILE *fr, int transparency) {
-    uint8_t toss;
+uint32_t readPixel(FILE *fr, int transparency) { /* Pixels without transparency data are left with an alpha of 0. */
+    uint8_t alpha;
     uint32_t pixel = 0;
 
     fread(&pixel, 3 * sizeof(uint8_t), 1, fr);
-    if(transparency)
-        fread(&toss, sizeof(uint8_t), 1, fr);
+    if(transparency) {
+        fread(&alpha, sizeof(uint8_t), 1, fr);
+        pixel |= (uint32_t)alpha << 24;
+    }
 
     return pixel;
 }
@@ -5,8 +5,13 @@ File: bmp.h
 
 === Timeline ===
 20240801 - File created.
+20261019 - Added include guard since the header is now included by more than one file.
+20261019 - Pixels carry their alpha in the top byte.
 */
 
+#ifndef BMP_H
+#define BMP_H
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -37,9 +42,14 @@ struct RGBColor {
     uint8_t a;
 };
 
+#define PIXEL_ALPHA(pixel) ((pixel) >> 24)
+#define PIXEL_OPAQUE 0xFF000000
+
 struct BMPHeader readBMPHeader(FILE*);
 struct RGBColor readRGB(FILE*, int);
 uint32_t readPixel(FILE*, int);
 struct RGBColor pixelToRGB(uint32_t);
 uint32_t rgbToPixel(struct RGBColor);
-void printBMPHeader(struct BMPHeader);
\ No newline at end of file
+void printBMPHeader(struct BMPHeader);
+
+#endif
\ No newline at end of file
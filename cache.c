@@ -0,0 +1,339 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: cache.c
+
+Note: The same image is often converted again and again, by a pipeline rerunning or by several processes working on one batch.
+The plan cache keeps every finished plan on disk, named by a hash of everything the plan depends on: the bytes of the bmp file,
+the colors of the key, the level of detail, the options of the auto tuner and CACHE_VERSION. The names of the blocks are not part
+of the hash, the plan only holds color indices and the names are put in when it is written.
+The raw bytes of the file are hashed rather than the decoded pixels, so a hit skips reading the pixels as well as quantizing them,
+building the quad and optimizing the commands. An entry holds the quantized grid and the markers of the plan.
+
+Many processes can share one cache directory:
+    An entry is written to a temporary file named after the process and thread, then moved over the entry in one step, so
+    nobody ever reads half an entry. When the move fails because another process has the entry open, the temporary file is
+    dropped, the entry there holds the same plan.
+    A hit sets the entry's last write time to now, which makes it the most recently used. The last access time is not used
+    since NTFS often does not keep it up to date.
+    After a store, when the entries take up more than the limit, the least recently used are deleted until they fit.
+    Only one process evicts at a time, the others skip it while evict.lock is held. An entry that is open can not be deleted
+    and is skipped.
+
+Timeline:
+20261019 - File created.
+20261019 - planImage runs under the current job. A cancelled plan is not stored.
+20261019 - planImage matches the image as it reads it, without keeping its pixels.
+20261019 - planImage fails on a bmp it can not read instead of caching an empty plan. cacheLoad checks every command and cell against the grid and the key.
+20261019 - The auto tuner is asked to print the levels it tried.
+20261019 - cacheLoad checks the header was read before looking at any of its sizes.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "cache.h"
+#include "commands.h"
+#include "job.h"
+#include "palette.h"
+#include "tune.h"
+
+#define FNV_PRIME 0x100000001B3ULL
+
+struct CacheHeader {
+    char magic[8];
+    int version;
+    struct CacheKey key;
+    int detail;
+    int width;
+    int height;
+    int commands;
+};
+
+struct CacheEntry { /* An entry found while evicting. */
+    char name[260];
+    long long size;
+    FILETIME used;
+};
+
+void cacheOpen(struct PlanCache *c, char *dir, int megabytes) {
+    strncpy(c->dir, dir, sizeof(c->dir) - 1);
+    c->dir[sizeof(c->dir) - 1] = '\0';
+    c->limit = (long long)(megabytes > 0 ? megabytes:CACHE_DEFAULT_MB) * 1024 * 1024;
+    CreateDirectoryA(c->dir, NULL); /* Fails harmlessly when it is already there. */
+}
+
+void hashBytes(struct CacheKey *k, void *data, long length) { /* Two FNV-1a hashes started from different offsets. */
+    uint8_t *bytes = data;
+    long i;
+    for(i = 0 ; i < length ; i++) {
+        k->high = (k->high ^ bytes[i]) * FNV_PRIME;
+        k->low = (k->low ^ bytes[i]) * FNV_PRIME;
+    }
+}
+
+void hashInt(struct CacheKey *k, int value) { /* Lowest byte first, so the hash does not depend on the machine. */
+    uint8_t bytes[4] = {value & 0xFF, (value >> 8) & 0xFF, (value >> 16) & 0xFF, (value >> 24) & 0xFF};
+    hashBytes(k, bytes, 4);
+}
+
+struct CacheKey cacheKey(uint8_t *image, long length, struct RGBColor *key, int colors, int detail) {
+    struct CacheKey k = {0xCBF29CE484222325ULL, 0x6C62272E07BB0142ULL};
+    int i;
+
+    hashInt(&k, CACHE_VERSION);
+    hashInt(&k, detail > 0 ? detail:0);
+    hashInt(&k, detail > 0 ? 0:TUNE_ERROR_BUDGET);
+    hashInt(&k, colors);
+    for(i = 0 ; i < colors ; i++) {
+        uint8_t rgb[3] = {key[i].r, key[i].g, key[i].b};
+        hashBytes(&k, rgb, 3);
+    }
+    hashInt(&k, (int)length);
+    hashBytes(&k, image, length);
+    return k;
+}
+
+void entryName(struct PlanCache *c, struct CacheKey *k, char *path) {
+    sprintf(path, "%s\\%08lx%08lx%08lx%08lx.plan", c->dir, (unsigned long)(k->high >> 32), (unsigned long)(k->high & 0xFFFFFFFF),
+        (unsigned long)(k->low >> 32), (unsigned long)(k->low & 0xFFFFFFFF));
+}
+
+void touchEntry(char *path) { /* Marks the entry as just used. */
+    HANDLE h = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    FILETIME now;
+
+    if(h == INVALID_HANDLE_VALUE)
+        return;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(h, NULL, NULL, &now);
+    CloseHandle(h);
+}
+
+int markerFits(int *m, struct Grid *grid, int colors) { /* A cached command stays inside the grid and the color key. */
+    int width = m[2] - m[0], height = m[3] - m[1];
+    if(m[0] < 0 || m[1] < 0 || width < 0 || height < 0 || m[2] >= grid->width || m[3] >= grid->height)
+        return 0;
+    if(m[5]) /* A clone, its copy has to land inside the grid too. */
+        return m[6] >= 0 && m[7] >= 0 && m[6] + width < grid->width && m[7] + height < grid->height;
+    return m[4] >= 0 && m[4] < colors;
+}
+
+int cacheLoad(struct PlanCache *c, struct CacheKey *k, int colors, struct LinkedList *plan, struct Grid *grid, int *detail) {
+    /* Appends the cached plan to 'plan' and fills 'grid', returns 0 and leaves both alone when there is no usable entry.
+    An entry that is corrupt or was not written by this version counts as no entry, nothing in it is trusted to index the key. */
+    struct LinkedList loaded = {NULL, NULL};
+    struct CacheHeader h;
+    char path[300];
+    int i, j, m[8], ok;
+    FILE *fr;
+
+    entryName(c, k, path);
+    if((fr = fopen(path, "rb")) == NULL)
+        return 0;
+
+    ok = fread(&h, sizeof(h), 1, fr) == 1 && memcmp(h.magic, "MIMMPLAN", 8) == 0 && h.version == CACHE_VERSION
+        && h.key.high == k->high && h.key.low == k->low && h.width == grid->width && h.height == grid->height && h.commands >= 0
+        && h.detail >= 1 && h.detail <= 128;
+    for(i = 0 ; ok && i < h.height ; i++) {
+        ok = fread(&GRID(grid, i, 0), 1, h.width, fr) == (size_t)h.width;
+        for(j = 0 ; ok && j < h.width ; j++)
+            ok = GRID(grid, i, j) < colors || GRID(grid, i, j) == GRID_EMPTY;
+    }
+    for(i = 0 ; ok && i < h.commands ; i++) {
+        if((ok = fread(m, sizeof(int), 8, fr) == 8 && markerFits(m, grid, colors)))
+            LL_append(&loaded, m[5] ? allocCloneMarker(m[0], m[1], m[2], m[3], m[6], m[7]):allocMarker(m[0], m[1], m[2], m[3], m[4]));
+    }
+    fclose(fr);
+
+    if(!ok) { /* The grid may be partly overwritten, the caller makes it again on a miss. */
+        freeQueue(&loaded);
+        return 0;
+    }
+    if(LL_empty(plan))
+        *plan = loaded;
+    else if(!LL_empty(&loaded)) {
+        plan->tail->next = loaded.head;
+        plan->tail = loaded.tail;
+    }
+    *detail = h.detail;
+    touchEntry(path);
+    return 1;
+}
+
+int compareEntryUse(const void *a, const void *b) {
+    return CompareFileTime(&((const struct CacheEntry*)a)->used, &((const struct CacheEntry*)b)->used);
+}
+
+void cacheEvict(struct PlanCache *c) { /* Deletes the least recently used entries until the rest fit in the limit. */
+    struct CacheEntry *entries = NULL;
+    WIN32_FIND_DATAA found;
+    HANDLE lock, find;
+    char path[300];
+    int i, count = 0, capacity = 0;
+    long long total = 0;
+
+    sprintf(path, "%s\\evict.lock", c->dir);
+    lock = CreateFileA(path, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if(lock == INVALID_HANDLE_VALUE) /* Another process is evicting. */
+        return;
+
+    sprintf(path, "%s\\*.plan", c->dir);
+    if((find = FindFirstFileA(path, &found)) != INVALID_HANDLE_VALUE) {
+        do {
+            if(found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                continue;
+            if(count == capacity) {
+                capacity = capacity > 0 ? capacity * 2:64;
+                entries = realloc(entries, capacity * sizeof(struct CacheEntry));
+            }
+            strcpy(entries[count].name, found.cFileName);
+            entries[count].size = (long long)found.nFileSizeHigh << 32 | found.nFileSizeLow;
+            entries[count].used = found.ftLastWriteTime;
+            total += entries[count++].size;
+        } while(FindNextFileA(find, &found));
+        FindClose(find);
+    }
+
+    if(total > c->limit) {
+        qsort(entries, count, sizeof(struct CacheEntry), compareEntryUse);
+        for(i = 0 ; i < count && total > c->limit ; i++) {
+            sprintf(path, "%s\\%s", c->dir, entries[i].name);
+            if(DeleteFileA(path))
+                total -= entries[i].size;
+        }
+    }
+
+    free(entries);
+    CloseHandle(lock);
+}
+
+void cacheStore(struct PlanCache *c, struct CacheKey *k, struct LinkedList *plan, struct Grid *grid, int detail) {
+    struct CacheHeader h;
+    struct Node *n;
+    char path[300], temp[340];
+    int i, ok;
+    FILE *fw;
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "MIMMPLAN", 8);
+    h.version = CACHE_VERSION;
+    h.key = *k;
+    h.detail = detail;
+    h.width = grid->width;
+    h.height = grid->height;
+    h.commands = queueLength(plan);
+
+    entryName(c, k, path);
+    sprintf(temp, "%s.%lu.%lu.tmp", path, (unsigned long)GetCurrentProcessId(), (unsigned long)GetCurrentThreadId());
+    if((fw = fopen(temp, "wb")) == NULL)
+        return;
+
+    fwrite(&h, sizeof(h), 1, fw);
+    for(i = 0 ; i < h.height ; i++)
+        fwrite(&GRID(grid, i, 0), 1, h.width, fw);
+    for(n = plan->head ; n != NULL ; n = n->next) {
+        struct Marker *m = n->marker;
+        int fields[8] = {m->startCol, m->startRow, m->endCol, m->endRow, m->colorKey, m->clone, m->destCol, m->destRow};
+        fwrite(fields, sizeof(int), 8, fw);
+    }
+    ok = !ferror(fw);
+    ok = fclose(fw) == 0 && ok;
+
+    if(!ok || !MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING))
+        DeleteFileA(temp);
+    else
+        cacheEvict(c);
+}
+
+/*
+Converts an image into a plan, or takes the plan from the cache when 'c' is given and has it. Detail 0 lets the auto tuner pick.
+Fills the 128 by 128 'grid' with the quantized image and returns the level of detail used, or 0 if the image could not be opened or is not a bmp it can read.
+When the current job is cancelled the plan is left incomplete, the caller checks jobCancelled() before using it.
+*/
+int planImage(struct PlanCache *c, char *image, struct RGBColor *key, int colors, int detail, struct LinkedList *plan, struct Grid *grid, int *hit) {
+    FILE *fr = fopen(image, "rb");
+    struct CacheKey k;
+    struct Quad q;
+    struct BMPHeader h;
+    uint8_t *bytes;
+    long length;
+
+    *hit = 0;
+    if(fr == NULL)
+        return 0;
+    reportProgress(JOB_READ, 0, 1);
+
+    if(c != NULL) {
+        fseek(fr, 0, SEEK_END);
+        length = ftell(fr);
+        rewind(fr);
+        bytes = malloc(length > 0 ? length:1);
+        length = fread(bytes, 1, length > 0 ? length:0, fr);
+        k = cacheKey(bytes, length, key, colors, detail);
+        free(bytes);
+        if(cacheLoad(c, &k, colors, plan, grid, &detail)) {
+            fclose(fr);
+            *hit = 1;
+            return detail;
+        }
+        rewind(fr);
+    }
+
+    h = readBMPHeader(fr);
+    if(!decodeQuantize(fr, &h, key, colors, grid, NULL)) {
+        fclose(fr);
+        return 0;
+    }
+    fclose(fr);
+    q = buildQuadExact(grid, colors, 128);
+    if(detail <= 0)
+        detail = autoTune(&q, grid, colors, TUNE_ERROR_BUDGET, 1, plan);
+    else {
+        quad(&q, plan, NULL, detail, 0);
+        optimizeCommands(plan, colors, detail);
+    }
+    if(c != NULL && !jobCancelled())
+        cacheStore(c, &k, plan, grid, detail);
+
+    destroyQuad(&q);
+    return detail;
+}
+
+void convertMode(char *image, char *key, int detail, char *cacheDir, int megabytes) {
+    struct LinkedList plan = {NULL, NULL};
+    struct PlanCache cache;
+    struct RGBColor *colors;
+    struct Grid *grid;
+    LARGE_INTEGER start, end, frequency;
+    uint32_t *pixelKey;
+    char **names;
+    int n, hit, commands;
+
+    if((n = loadColorKey(key, &names, &colors, &pixelKey)) <= 0) {
+        printf("Convert mode could not load the color key %s.\n", key);
+        return;
+    }
+    if(cacheDir != NULL && cacheDir[0] != '\0')
+        cacheOpen(&cache, cacheDir, megabytes);
+
+    grid = allocGrid(128, 128);
+    QueryPerformanceCounter(&start);
+    detail = planImage(cacheDir != NULL && cacheDir[0] != '\0' ? &cache:NULL, image, colors, n, detail, &plan, grid, &hit);
+    QueryPerformanceCounter(&end);
+    QueryPerformanceFrequency(&frequency);
+
+    if(detail == 0)
+        printf("Convert mode could not open or read %s.\n", image);
+    else {
+        commands = queueLength(&plan);
+        printf("%i commands at detail %i in %.2f ms%s.\n", commands, detail, (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart,
+            cacheDir == NULL || cacheDir[0] == '\0' ? "":hit ? ", from the cache":", added to the cache");
+        writeCommands(&plan, names, pixelKey);
+    }
+
+    freeGrid(grid);
+    freeColorNames(names);
+    free(colors);
+    free(pixelKey);
+}
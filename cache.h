@@ -0,0 +1,39 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: cache.h
+
+Timeline:
+20261019 - File created.
+20261019 - cacheLoad takes the number of colors in the key.
+*/
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include "linkedList.h"
+#include "grid.h"
+#include "bmp.h"
+
+#define CACHE_VERSION 1 /* Goes up whenever the planner would make a different plan, so older entries stop matching. */
+#define CACHE_DEFAULT_MB 256 /* Megabytes of entries kept before the least recently used are evicted. */
+
+struct CacheKey { /* 128 bit hash of everything a plan depends on. */
+    uint64_t high;
+    uint64_t low;
+};
+
+struct PlanCache {
+    char dir[260];
+    long long limit; /* Bytes. */
+};
+
+void cacheOpen(struct PlanCache *c, char *dir, int megabytes);
+struct CacheKey cacheKey(uint8_t *image, long length, struct RGBColor *key, int colors, int detail);
+int cacheLoad(struct PlanCache *c, struct CacheKey *k, int colors, struct LinkedList *plan, struct Grid *grid, int *detail);
+void cacheStore(struct PlanCache *c, struct CacheKey *k, struct LinkedList *plan, struct Grid *grid, int detail);
+int planImage(struct PlanCache *c, char *image, struct RGBColor *key, int colors, int detail, struct LinkedList *plan, struct Grid *grid, int *hit);
+void convertMode(char *image, char *key, int detail, char *cacheDir, int megabytes);
+
+#endif
@@ -0,0 +1,418 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: chunks.c
+
+Note: Commands used to be written in the order the optimizer made them, which is color by color and jumps all over the map.
+On a wall of maps that means the server keeps loading and saving chunks, and a fill reaching into a chunk that is not loaded fails.
+Chunk ordering walks the 16 by 16 chunks along a Hilbert curve or a serpentine, and writes the commands of each chunk together.
+Each command belongs to the first chunk it touches along the curve.
+Only commands that touch the same cells have to keep their order: a later command paints over an earlier one, and a clone copies
+what the commands before it left behind. Two fills of the same block can trade places. Those pairs are found chunk by chunk,
+then commands are handed out in the current chunk for as long as one is free to go, before moving on along the curve.
+The curve wraps back to the start to pick up commands that had to wait for a later chunk.
+Fills that straddle chunk edges can be split into one fill per chunk. That costs commands, but every command then needs one chunk loaded.
+Chunk coordinates are taken from the corner the plan is relative to, so the commands should be run from a chunk corner.
+Maps are lined up on chunks, so the corner of a map always is one.
+
+Timeline:
+20261019 - File created.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "chunks.h"
+#include "commands.h"
+#include "palette.h"
+
+struct ChunkGrid {
+    int across; /* Chunks across. */
+    int down;
+    int *curve; /* Chunks in the order the curve visits them, numbered row * across + col. */
+    int *rank; /* Where every chunk is along the curve. */
+};
+
+void hilbertPoint(int side, int d, int *x, int *y) { /* The point at distance d along a Hilbert curve filling a side by side square. */
+    int s, rx, ry, t;
+
+    *x = 0;
+    *y = 0;
+    for(s = 1 ; s < side ; s *= 2) {
+        rx = 1 & (d / 2);
+        ry = 1 & (d ^ rx);
+        if(ry == 0) {
+            if(rx == 1) {
+                *x = s - 1 - *x;
+                *y = s - 1 - *y;
+            }
+            t = *x;
+            *x = *y;
+            *y = t;
+        }
+        *x += s * rx;
+        *y += s * ry;
+        d /= 4;
+    }
+}
+
+void initChunkGrid(struct ChunkGrid *c, int width, int height, int curve) {
+    int i, k, n = 0, side = 1, x, y;
+
+    c->across = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    c->down = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    c->curve = malloc(c->across * c->down * sizeof(int));
+    c->rank = malloc(c->across * c->down * sizeof(int));
+
+    if(curve == CHUNK_HILBERT) {
+        while(side < c->across || side < c->down)
+            side *= 2;
+        for(i = 0 ; i < side * side ; i++) { /* Points off the grid are skipped, the rest keep their order along the curve. */
+            hilbertPoint(side, i, &x, &y);
+            if(x < c->across && y < c->down)
+                c->curve[n++] = y * c->across + x;
+        }
+    }
+    else
+        for(y = 0 ; y < c->down ; y++)
+            for(k = 0 ; k < c->across ; k++)
+                c->curve[n++] = y * c->across + (y % 2 ? c->across - 1 - k:k);
+
+    for(i = 0 ; i < n ; i++)
+        c->rank[c->curve[i]] = i;
+}
+
+void freeChunkGrid(struct ChunkGrid *c) {
+    free(c->curve);
+    free(c->rank);
+}
+
+int markerAreas(struct Marker *m, int areas[2][4]) { /* The areas a command touches as start col, start row, end col, end row. Returns how many. */
+    areas[0][0] = m->startCol;
+    areas[0][1] = m->startRow;
+    areas[0][2] = m->endCol;
+    areas[0][3] = m->endRow;
+    if(!m->clone)
+        return 1;
+    areas[1][0] = m->destCol;
+    areas[1][1] = m->destRow;
+    areas[1][2] = m->destCol + m->endCol - m->startCol;
+    areas[1][3] = m->destRow + m->endRow - m->startRow;
+    return 2;
+}
+
+void areaChunks(struct ChunkGrid *c, int *area, int *chunks) { /* The chunks under an area, as first col, first row, last col, last row. */
+    int i;
+    for(i = 0 ; i < 4 ; i++)
+        chunks[i] = area[i] < 0 ? 0:area[i] / CHUNK_SIZE;
+    if(chunks[2] >= c->across)
+        chunks[2] = c->across - 1;
+    if(chunks[3] >= c->down)
+        chunks[3] = c->down - 1;
+}
+
+int areaTouches(int *area, int col, int row) { /* Whether an area reaches into the chunk at (col, row). */
+    return area[0] < (col + 1) * CHUNK_SIZE && area[2] >= col * CHUNK_SIZE && area[1] < (row + 1) * CHUNK_SIZE && area[3] >= row * CHUNK_SIZE;
+}
+
+int areasOverlap(int *a, int *b) {
+    return a[0] <= b[2] && b[0] <= a[2] && a[1] <= b[3] && b[1] <= a[3];
+}
+
+int markersConflict(struct Marker *a, struct Marker *b) { /* Whether swapping the two commands could change what ends up on the map. */
+    int i, j, na, nb, areasA[2][4], areasB[2][4];
+
+    if(!a->clone && !b->clone && a->colorKey == b->colorKey)
+        return 0;
+    na = markerAreas(a, areasA);
+    nb = markerAreas(b, areasB);
+    for(i = 0 ; i < na ; i++)
+        for(j = 0 ; j < nb ; j++)
+            if(areasOverlap(areasA[i], areasB[j]))
+                return 1;
+    return 0;
+}
+
+int newChunks(struct ChunkGrid *c, struct Marker *m, struct Marker *prev, uint8_t *touched) {
+    /* Counts the chunks the command needs that the command before it did not, marking them in 'touched'. */
+    int a, b, i, j, na, nb = 0, loads = 0, areas[2][4], prevAreas[2][4], chunks[4];
+
+    na = markerAreas(m, areas);
+    if(prev != NULL)
+        nb = markerAreas(prev, prevAreas);
+
+    for(a = 0 ; a < na ; a++) {
+        areaChunks(c, areas[a], chunks);
+        for(i = chunks[1] ; i <= chunks[3] ; i++)
+            for(j = chunks[0] ; j <= chunks[2] ; j++) {
+                int loaded = a == 1 && areaTouches(areas[0], j, i); /* Both areas of a clone can share a chunk. */
+                for(b = 0 ; b < nb && !loaded ; b++)
+                    loaded = areaTouches(prevAreas[b], j, i);
+                if(!loaded)
+                    loads++;
+                touched[i * c->across + j] = 1;
+            }
+    }
+    return loads;
+}
+
+int countLoads(struct ChunkGrid *c, struct LinkedList *plan, int *chunks) { /* Chunk loads going through the plan in order, and how many chunks it touches. */
+    int i, loads = 0;
+    uint8_t *touched = calloc(c->across * c->down, 1);
+    struct Node *n, *prev = NULL;
+
+    for(n = plan->head ; n != NULL ; n = n->next) {
+        loads += newChunks(c, n->marker, prev == NULL ? NULL:prev->marker, touched);
+        prev = n;
+    }
+    if(chunks != NULL)
+        for(*chunks = 0, i = 0 ; i < c->across * c->down ; i++)
+            *chunks += touched[i];
+
+    free(touched);
+    return loads;
+}
+
+int splitAtChunks(struct ChunkGrid *c, struct LinkedList *plan) { /* Cuts every fill that straddles chunk edges into one fill per chunk. Returns how many fills were added. */
+    struct LinkedList split = {NULL, NULL};
+    struct Marker *m;
+    int i, j, added = 0, areas[2][4], chunks[4];
+
+    while(!LL_empty(plan)) {
+        m = LL_removeHead(plan);
+        markerAreas(m, areas);
+        areaChunks(c, areas[0], chunks);
+        if(m->clone || (chunks[0] == chunks[2] && chunks[1] == chunks[3])) {
+            LL_append(&split, m);
+            continue;
+        }
+        for(i = chunks[1] ; i <= chunks[3] ; i++)
+            for(j = chunks[0] ; j <= chunks[2] ; j++) {
+                int startCol = j * CHUNK_SIZE, startRow = i * CHUNK_SIZE, endCol = startCol + CHUNK_SIZE - 1, endRow = startRow + CHUNK_SIZE - 1;
+                LL_append(&split, allocMarker(startCol > m->startCol ? startCol:m->startCol, startRow > m->startRow ? startRow:m->startRow,
+                    endCol < m->endCol ? endCol:m->endCol, endRow < m->endRow ? endRow:m->endRow, m->colorKey));
+                added++;
+            }
+        added--;
+        free(m);
+    }
+
+    *plan = split;
+    return added;
+}
+
+int homeChunk(struct ChunkGrid *c, struct Marker *m) { /* The first chunk along the curve the command touches. */
+    int a, i, j, n, best = -1, areas[2][4], chunks[4];
+
+    n = markerAreas(m, areas);
+    for(a = 0 ; a < n ; a++) {
+        areaChunks(c, areas[a], chunks);
+        for(i = chunks[1] ; i <= chunks[3] ; i++)
+            for(j = chunks[0] ; j <= chunks[2] ; j++)
+                if(best == -1 || c->rank[i * c->across + j] < c->rank[best])
+                    best = i * c->across + j;
+    }
+    return best;
+}
+
+struct IntList {
+    int *items;
+    int n;
+    int capacity;
+};
+
+void pushInt(struct IntList *list, int item) {
+    if(list->n == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2:8;
+        list->items = realloc(list->items, list->capacity * sizeof(int));
+    }
+    list->items[list->n++] = item;
+}
+
+void chunkOrder(struct LinkedList *plan, int width, int height, int curve, int split, struct ChunkReport *report) {
+    /* Reorders the plan chunk by chunk along the curve, keeping every pair of commands that touch the same cells in order. */
+    struct ChunkGrid c;
+    struct Marker **markers;
+    struct IntList *buckets, from = {NULL, 0, 0}, to = {NULL, 0, 0};
+    struct Node *node;
+    int a, i, j, k, n = 0, chunks, current = -1, *home, *waiting, *seen, *edgeStart, *edges, *homeStart, *homeList, *cursor, *ready, areas[2][4], span[4];
+
+    initChunkGrid(&c, width, height, curve);
+    chunks = c.across * c.down;
+    report->before = countLoads(&c, plan, NULL);
+    report->splits = split ? splitAtChunks(&c, plan):0;
+
+    for(node = plan->head ; node != NULL ; node = node->next)
+        n++;
+    markers = malloc(n * sizeof(struct Marker*));
+    for(i = 0 ; i < n ; i++)
+        markers[i] = LL_removeHead(plan);
+    plan->head = NULL;
+    plan->tail = NULL;
+
+    buckets = calloc(chunks, sizeof(struct IntList)); /* The earlier commands touching each chunk. */
+    seen = malloc(n * sizeof(int));
+    home = malloc(n * sizeof(int));
+    waiting = calloc(n, sizeof(int)); /* Earlier commands that still have to be written first. */
+    for(i = 0 ; i < n ; i++)
+        seen[i] = -1;
+
+    for(j = 0 ; j < n ; j++) {
+        int na = markerAreas(markers[j], areas);
+        home[j] = homeChunk(&c, markers[j]);
+        for(a = 0 ; a < na ; a++) {
+            areaChunks(&c, areas[a], span);
+            for(i = span[1] ; i <= span[3] ; i++)
+                for(k = span[0] ; k <= span[2] ; k++) {
+                    struct IntList *bucket = &buckets[i * c.across + k];
+                    int b;
+                    if(bucket->n > 0 && bucket->items[bucket->n - 1] == j) /* Both areas of a clone in one chunk. */
+                        continue;
+                    for(b = 0 ; b < bucket->n ; b++) {
+                        int earlier = bucket->items[b];
+                        if(seen[earlier] == j)
+                            continue;
+                        seen[earlier] = j;
+                        if(markersConflict(markers[earlier], markers[j])) {
+                            pushInt(&from, earlier);
+                            pushInt(&to, j);
+                            waiting[j]++;
+                        }
+                    }
+                    pushInt(bucket, j);
+                }
+        }
+    }
+
+    edgeStart = calloc(n + 1, sizeof(int)); /* The commands waiting on each command, edges[edgeStart[i]] to edges[edgeStart[i + 1] - 1]. */
+    edges = malloc((from.n + 1) * sizeof(int));
+    for(i = 0 ; i < from.n ; i++)
+        edgeStart[from.items[i] + 1]++;
+    for(i = 0 ; i < n ; i++)
+        edgeStart[i + 1] += edgeStart[i];
+    memset(seen, 0, n * sizeof(int)); /* Now how many edges of each command are in place. */
+    for(i = 0 ; i < from.n ; i++)
+        edges[edgeStart[from.items[i]] + seen[from.items[i]]++] = to.items[i];
+
+    homeStart = calloc(chunks + 1, sizeof(int)); /* The commands of each chunk in plan order. */
+    homeList = malloc(n * sizeof(int));
+    cursor = malloc(chunks * sizeof(int));
+    ready = calloc(chunks, sizeof(int)); /* Commands of each chunk that are free to be written. */
+    for(i = 0 ; i < n ; i++)
+        homeStart[home[i] + 1]++;
+    for(i = 0 ; i < chunks ; i++)
+        homeStart[i + 1] += homeStart[i];
+    memcpy(cursor, homeStart, chunks * sizeof(int));
+    for(i = 0 ; i < n ; i++)
+        homeList[cursor[home[i]]++] = i;
+    memcpy(cursor, homeStart, chunks * sizeof(int));
+    for(i = 0 ; i < n ; i++)
+        if(waiting[i] == 0)
+            ready[home[i]]++;
+
+    for(k = 0 ; k < n ; k++) {
+        int chunk, pick = -1;
+        if(current == -1 || ready[c.curve[current]] == 0) /* Move on along the curve to the next chunk with a command free to go. */
+            for(i = 1 ; i <= chunks ; i++)
+                if(ready[c.curve[(current + i + chunks) % chunks]] > 0) {
+                    current = (current + i + chunks) % chunks;
+                    break;
+                }
+        chunk = c.curve[current];
+
+        while(cursor[chunk] < homeStart[chunk + 1] && markers[homeList[cursor[chunk]]] == NULL) /* Skip what was already written. */
+            cursor[chunk]++;
+        for(i = cursor[chunk] ; pick == -1 ; i++)
+            if(markers[homeList[i]] != NULL && waiting[homeList[i]] == 0)
+                pick = homeList[i];
+
+        LL_append(plan, markers[pick]);
+        markers[pick] = NULL;
+        ready[chunk]--;
+        for(i = edgeStart[pick] ; i < edgeStart[pick + 1] ; i++)
+            if(--waiting[edges[i]] == 0)
+                ready[home[edges[i]]]++;
+    }
+
+    report->commands = n;
+    report->after = countLoads(&c, plan, &report->chunks);
+
+    for(i = 0 ; i < chunks ; i++)
+        free(buckets[i].items);
+    free(buckets);
+    free(from.items);
+    free(to.items);
+    free(markers);
+    free(seen);
+    free(home);
+    free(waiting);
+    free(edgeStart);
+    free(edges);
+    free(homeStart);
+    free(homeList);
+    free(cursor);
+    free(ready);
+    freeChunkGrid(&c);
+}
+
+void printChunkReport(struct ChunkReport *report) {
+    printf("Chunk order: %i commands, %i from splitting fills at chunk edges. Chunk loads: %i before, %i after, %i chunks touched.\n",
+        report->commands, report->splits, report->before, report->after, report->chunks);
+}
+
+void chunksMode(char *image, char *key, int detail, char *curve, int split) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r");
+    struct LinkedList plan = {NULL, NULL};
+    struct ChunkReport report;
+    struct Quad q;
+    struct Grid *grid, *before, *after;
+    char **colors;
+    uint32_t *pixelKey;
+    int n;
+
+    if(fr == NULL || colorKey == NULL) {
+        printf("Chunks mode could not open %s or %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    grid = allocGrid(128, 128);
+    before = allocGrid(128, 128);
+    after = allocGrid(128, 128);
+
+    quantizeImage(fr, colorKey, grid, NULL);
+    q = buildQuadExact(grid, n, 128);
+    quad(&q, &plan, NULL, detail, 0);
+    optimizeCommands(&plan, n, detail);
+    imprintGrid(&plan, before);
+
+    chunkOrder(&plan, 128, 128, strcmp(curve, "serpentine") == 0 ? CHUNK_SERPENTINE:CHUNK_HILBERT, split, &report);
+    printChunkReport(&report);
+    imprintGrid(&plan, after);
+    if(!gridsMatch(before, after))
+        printf("ERROR: The reordered commands do not paint the same map.\n");
+
+    writeCommands(&plan, colors, pixelKey);
+    destroyQuad(&q);
+    freeGrid(grid);
+    freeGrid(before);
+    freeGrid(after);
+    freeColorNames(colors);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+}
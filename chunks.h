@@ -0,0 +1,31 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: chunks.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef CHUNKS_H
+#define CHUNKS_H
+
+#include "linkedList.h"
+
+#define CHUNK_SIZE 16 /* Blocks across a Minecraft chunk. */
+#define CHUNK_SERPENTINE 0 /* Rows of chunks, every other row walked backwards. */
+#define CHUNK_HILBERT 1
+
+struct ChunkReport {
+    int commands; /* Commands after any splitting. */
+    int splits; /* Commands added by splitting fills at chunk edges. */
+    int chunks; /* Chunks touched by the plan, the fewest loads any order can get away with. */
+    int before; /* Chunk loads in the order the plan came in. */
+    int after;
+};
+
+void chunkOrder(struct LinkedList *plan, int width, int height, int curve, int split, struct ChunkReport *report);
+void printChunkReport(struct ChunkReport *report);
+void chunksMode(char *image, char *key, int detail, char *curve, int split);
+
+#endif
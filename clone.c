@@ -0,0 +1,295 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: clone.c
+
+Note: Pixel art and tiled images repeat the same blocks over and over, and every copy used to cost its own fills.
+Clone mode finds squares of cells that already appeared earlier in the image with a rolling hash. Each row of every square is hashed
+by sliding along the row, then the row hashes are slid down the columns, so every square's hash costs a few multiplies no matter its size.
+Spots with the same hash are compared cell by cell, and a match is grown right then down for as long as it keeps matching.
+The first copy is left to the fills. Every other copy becomes a /clone placed after all the fills, and its cells become GRID_EMPTY
+for the bitboard optimizer, so the fills may paint anything there.
+A copy can not be the source of a clone once it is the destination of one, and the source and destination of a clone never overlap,
+so every clone copies cells that are already final.
+If the clones do not end up saving commands, the plan is made without them.
+
+Timeline:
+20261019 - File created.
+20261019 - The plan is made with the parallel extraction.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "clone.h"
+#include "commands.h"
+#include "palette.h"
+#include "bitboard.h"
+
+#define CLONE_FREE 0
+#define CLONE_SOURCE 1
+#define CLONE_DEST 2
+
+#define CLONE_ROW_BASE 1000003ULL
+#define CLONE_COL_BASE 998244353ULL
+
+struct CloneSearch {
+    int width; /* Cells across. */
+    int height;
+    int size; /* Cells across the smallest square that is cloned. */
+    uint8_t *cells;
+    uint8_t *state; /* CLONE_FREE, CLONE_SOURCE or CLONE_DEST for every cell. */
+    uint64_t *hashes; /* The hash of the square with its top left corner at every cell. */
+    int *head; /* Chains of the earlier corners in every hash bucket. */
+    int *next;
+};
+
+uint64_t powerOf(uint64_t base, int exponent) {
+    uint64_t result = 1;
+    while(exponent-- > 0)
+        result *= base;
+    return result;
+}
+
+void hashSquares(struct CloneSearch *s) { /* Hashes are left to wrap around, a match is always checked cell by cell anyway. */
+    int i, j, k = s->size, across = s->width - k + 1, down = s->height - k + 1;
+    uint64_t rowPower = powerOf(CLONE_ROW_BASE, k - 1), colPower = powerOf(CLONE_COL_BASE, k - 1);
+    uint64_t *rows = malloc((size_t)s->height * across * sizeof(uint64_t));
+
+    for(i = 0 ; i < s->height ; i++) {
+        uint8_t *row = s->cells + i * s->width;
+        uint64_t h = 0;
+        for(j = 0 ; j < k ; j++)
+            h = h * CLONE_ROW_BASE + row[j] + 1;
+        rows[i * across] = h;
+        for(j = 1 ; j < across ; j++) {
+            h = (h - (uint64_t)(row[j - 1] + 1) * rowPower) * CLONE_ROW_BASE + row[j + k - 1] + 1;
+            rows[i * across + j] = h;
+        }
+    }
+
+    for(j = 0 ; j < across ; j++) {
+        uint64_t h = 0;
+        for(i = 0 ; i < k ; i++)
+            h = h * CLONE_COL_BASE + rows[i * across + j];
+        s->hashes[j] = h;
+        for(i = 1 ; i < down ; i++) {
+            h = (h - rows[(i - 1) * across + j] * colPower) * CLONE_COL_BASE + rows[(i + k - 1) * across + j];
+            s->hashes[i * s->width + j] = h;
+        }
+    }
+    free(rows);
+}
+
+int regionsMatch(struct CloneSearch *s, int srcRow, int srcCol, int destRow, int destCol, int rows, int cols) {
+    int i;
+    for(i = 0 ; i < rows ; i++)
+        if(memcmp(s->cells + (srcRow + i) * s->width + srcCol, s->cells + (destRow + i) * s->width + destCol, cols) != 0)
+            return 0;
+    return 1;
+}
+
+int regionState(struct CloneSearch *s, int row, int col, int rows, int cols, int dest) { /* 1 when every cell may be a destination (or a source). */
+    int i, j;
+    for(i = row ; i < row + rows ; i++)
+        for(j = col ; j < col + cols ; j++) {
+            int state = s->state[i * s->width + j];
+            if(dest ? state != CLONE_FREE:state == CLONE_DEST)
+                return 0;
+        }
+    return 1;
+}
+
+void markRegion(struct CloneSearch *s, int row, int col, int rows, int cols, int state) {
+    int i, j;
+    for(i = row ; i < row + rows ; i++)
+        for(j = col ; j < col + cols ; j++)
+            if(s->state[i * s->width + j] != CLONE_DEST)
+                s->state[i * s->width + j] = state;
+}
+
+int squareRuns(struct CloneSearch *s, int row, int col) { /* Runs of one color across the rows of a square. */
+    int i, j, runs = 0;
+    for(i = row ; i < row + s->size ; i++) {
+        uint8_t *cells = s->cells + i * s->width + col;
+        runs++;
+        for(j = 1 ; j < s->size ; j++)
+            runs += cells[j] != cells[j - 1];
+    }
+    return runs;
+}
+
+int overlaps(int srcRow, int srcCol, int destRow, int destCol, int rows, int cols) {
+    return abs(srcRow - destRow) < rows && abs(srcCol - destCol) < cols;
+}
+
+int growClone(struct CloneSearch *s, int srcRow, int srcCol, int destRow, int destCol, int *rows, int *cols, int detail) {
+    /* Grows a matching square right then down, returns 1 while it fits the volume limit. */
+    int volume = detail * detail;
+
+    while(destCol + *cols < s->width && srcCol + *cols < s->width && !overlaps(srcRow, srcCol, destRow, destCol, *rows, *cols + 1)
+        && (*rows) * (*cols + 1) * volume <= CLONE_VOLUME_LIMIT
+        && regionState(s, destRow, destCol + *cols, *rows, 1, 1) && regionState(s, srcRow, srcCol + *cols, *rows, 1, 0)
+        && regionsMatch(s, srcRow, srcCol + *cols, destRow, destCol + *cols, *rows, 1))
+        (*cols)++;
+
+    while(destRow + *rows < s->height && srcRow + *rows < s->height && !overlaps(srcRow, srcCol, destRow, destCol, *rows + 1, *cols)
+        && (*rows + 1) * (*cols) * volume <= CLONE_VOLUME_LIMIT
+        && regionState(s, destRow + *rows, destCol, 1, *cols, 1) && regionState(s, srcRow + *rows, srcCol, 1, *cols, 0)
+        && regionsMatch(s, srcRow + *rows, srcCol, destRow + *rows, destCol, 1, *cols))
+        (*rows)++;
+
+    return (*rows) * (*cols) * volume <= CLONE_VOLUME_LIMIT;
+}
+
+int findClones(struct CloneSearch *s, int detail, struct LinkedList *clones) { /* Appends a clone marker for every repeat, returns how many. */
+    int i, j, count = 0, k = s->size;
+
+    for(i = 0 ; i + k <= s->height ; i++)
+        for(j = 0 ; j + k <= s->width ; j++) {
+            int corner = i * s->width + j, bucket = s->hashes[corner] % CLONE_HASH_BUCKETS, candidate = s->head[bucket], checked = 0;
+
+            if(regionState(s, i, j, k, k, 1) && squareRuns(s, i, j) >= k + 2) /* A square with less than two breaks costs no more than a clone. */
+                while(candidate != -1 && checked++ < CLONE_CHAIN_LIMIT) {
+                    int srcRow = candidate / s->width, srcCol = candidate % s->width, rows = k, cols = k;
+                    if(s->hashes[candidate] == s->hashes[corner] && !overlaps(srcRow, srcCol, i, j, k, k)
+                        && regionState(s, srcRow, srcCol, k, k, 0) && regionsMatch(s, srcRow, srcCol, i, j, k, k)
+                        && growClone(s, srcRow, srcCol, i, j, &rows, &cols, detail)) {
+                        markRegion(s, i, j, rows, cols, CLONE_DEST);
+                        markRegion(s, srcRow, srcCol, rows, cols, CLONE_SOURCE);
+                        LL_append(clones, allocCloneMarker(srcCol * detail, srcRow * detail, (srcCol + cols) * detail - 1, (srcRow + rows) * detail - 1, j * detail, i * detail));
+                        count++;
+                        break;
+                    }
+                    candidate = s->next[candidate];
+                }
+
+            s->next[corner] = s->head[bucket];
+            s->head[bucket] = corner;
+        }
+    return count;
+}
+
+int planWithBitboard(struct Grid *grid, int colors, int detail, struct LinkedList *plan) { /* Appends the optimized fills for the grid to the plan when it is not NULL. */
+    struct Bitboard *b = allocBitboard(grid, colors, detail, 0);
+    int n, commands, *order = malloc(colors * sizeof(int));
+
+    n = bitboardOrder(b, order);
+    commands = bitboardCommandsParallel(b, order, n, plan);
+    freeBitboard(b);
+    free(order);
+    return commands;
+}
+
+int cloneCommands(struct Grid *grid, int colors, int detail, int minSize, struct LinkedList *plan) {
+    /* Appends the fills and then the clones that paint the grid to the plan. Returns how many clones were used. */
+    struct CloneSearch s;
+    struct LinkedList clones = {NULL, NULL};
+    struct Grid *masked;
+    struct Node *n;
+    int i, j, count;
+
+    s.width = grid->width / detail;
+    s.height = grid->height / detail;
+    s.size = minSize / detail < 2 ? 2:minSize / detail;
+    if(s.size > s.width || s.size > s.height) {
+        planWithBitboard(grid, colors, detail, plan);
+        return 0;
+    }
+
+    s.cells = malloc(s.width * s.height);
+    s.state = calloc(s.width * s.height, 1);
+    s.hashes = malloc((size_t)s.width * s.height * sizeof(uint64_t));
+    s.head = malloc(CLONE_HASH_BUCKETS * sizeof(int));
+    s.next = malloc(s.width * s.height * sizeof(int));
+    for(i = 0 ; i < s.height ; i++)
+        for(j = 0 ; j < s.width ; j++)
+            s.cells[i * s.width + j] = GRID(grid, i * detail, j * detail);
+    for(i = 0 ; i < CLONE_HASH_BUCKETS ; i++)
+        s.head[i] = -1;
+
+    hashSquares(&s);
+    count = findClones(&s, detail, &clones);
+
+    masked = allocGrid(grid->width, grid->height);
+    copyGrid(masked, grid);
+    for(n = clones.head ; n != NULL ; n = n->next) {
+        struct Marker *m = n->marker;
+        fillGrid(masked, m->destRow, m->destCol, m->destRow + m->endRow - m->startRow, m->destCol + m->endCol - m->startCol, GRID_EMPTY);
+    }
+
+    if(count > 0 && planWithBitboard(masked, colors, detail, NULL) + count < planWithBitboard(grid, colors, detail, NULL)) {
+        planWithBitboard(masked, colors, detail, plan);
+        while(!LL_empty(&clones))
+            LL_append(plan, LL_removeHead(&clones));
+    }
+    else {
+        freeQueue(&clones);
+        planWithBitboard(grid, colors, detail, plan);
+        count = 0;
+    }
+
+    freeGrid(masked);
+    free(s.cells);
+    free(s.state);
+    free(s.hashes);
+    free(s.head);
+    free(s.next);
+    return count;
+}
+
+void cloneMode(char *image, char *key, int detail, int minSize) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r");
+    struct LinkedList plan = {NULL, NULL};
+    struct Quad q;
+    int n, clones, fills;
+    struct Grid *grid, *original, *cloned;
+    char **colors;
+    uint32_t *pixelKey;
+
+    if(fr == NULL || colorKey == NULL) {
+        printf("Clone mode could not open %s or %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    grid = allocGrid(128, 128);
+    original = allocGrid(128, 128);
+    cloned = allocGrid(128, 128);
+
+    quantizeImage(fr, colorKey, grid, NULL);
+    q = buildQuadExact(grid, n, 128);
+    quad(&q, &plan, NULL, detail, 0);
+    imprintGrid(&plan, original);
+    freeQueue(&plan);
+    fills = planWithBitboard(original, n, detail, NULL);
+    clones = cloneCommands(original, n, detail, minSize, &plan);
+    imprintGrid(&plan, cloned);
+    if(!gridsMatch(original, cloned))
+        printf("ERROR: The cloned commands do not match the quad.\n");
+    printf("Clone: %i commands with %i clones, %i commands without.\n", queueLength(&plan), clones, fills);
+
+    writeCommands(&plan, colors, pixelKey);
+    destroyQuad(&q);
+    freeGrid(grid);
+    freeGrid(original);
+    freeGrid(cloned);
+    freeColorNames(colors);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+}
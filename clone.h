@@ -0,0 +1,24 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: clone.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef CLONE_H
+#define CLONE_H
+
+#include "linkedList.h"
+#include "grid.h"
+
+#define CLONE_MIN_SIZE 8 /* Pixels across the smallest square a repeat has to cover before it is cloned. */
+#define CLONE_VOLUME_LIMIT 32768 /* The most blocks one /clone command may copy. */
+#define CLONE_CHAIN_LIMIT 64 /* How many earlier spots with the same hash are compared before giving up on a spot. */
+#define CLONE_HASH_BUCKETS 4096
+
+int cloneCommands(struct Grid *grid, int colors, int detail, int minSize, struct LinkedList *plan);
+void cloneMode(char *image, char *key, int detail, int minSize);
+
+#endif
@@ -0,0 +1,246 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: commands.c
+
+Note: This file holds the command generation and optimization steps that do not depend on the window.
+Functions were transfered over from main.c so the auto tuner (and any future headless modes) can share them.
+
+Timeline:
+20261019 - File created. Transfered grid and command optimization functions over from main file.
+Added countMismatches and queue helpers for the auto tuner.
+mergeColor no longer reads past the last row when the level of detail is above 1.
+20261019 - Added writeCommands so every mode writes commands.txt and pixelColors.txt the same way.
+20261019 - Added writePlan for modes that write more than one set of commands.
+20261019 - Split mergeCommands up so the colors can be extracted in any order. Added optimizeCommandsOrdered and heuristicOrder.
+20261019 - Grid functions moved to grid.c. imprintGrid fills whole rows of the new grid at a time.
+20261019 - The linked list optimizer is replaced by the bitboard optimizer in bitboard.c. optimizeCommands keeps the same priority order.
+heuristicOrder, optimizeCommandsOrdered and transposeQueue are gone, the search works on bitboards directly.
+20261019 - imprintGrid and writeCommand handle clone markers. A clone writes 0 to pixelColors.txt to keep the lines lined up.
+20261019 - quad skips regions that are all GRID_EMPTY.
+20261019 - optimizeCommands extracts the colors in parallel.
+20261019 - Added quadWithin and adaptiveQuad, which cut the quad by error instead of at one level of detail.
+*/
+
+#include "commands.h"
+#include <string.h>
+#include "bitboard.h"
+
+void imprintGrid(struct LinkedList *queue, struct Grid *grid) {
+    struct Node *n = queue->head;
+
+    clearGrid(grid); /* Since not all the indices may be filled, filling them with a default. */
+    while(n != NULL) {
+        if(n->marker->clone)
+            copyRegion(grid, n->marker);
+        else
+            fillGrid(grid, n->marker->startRow, n->marker->startCol, n->marker->endRow, n->marker->endCol, n->marker->colorKey);
+        n = n->next;
+    }
+}
+
+void copyRegion(struct Grid *grid, struct Marker *m) { /* Does what a clone marker does in game. The source and destination never overlap. */
+    int i;
+    for(i = 0 ; i <= m->endRow - m->startRow ; i++)
+        memcpy(&GRID(grid, m->destRow + i, m->destCol), &GRID(grid, m->startRow + i, m->startCol), m->endCol - m->startCol + 1);
+}
+
+void writeCommand(FILE *commands, struct Marker *marker, char **colors) {
+    if(marker->clone) {
+        fprintf(commands, "/clone ~%i ~-1 ~%i ~%i ~-1 ~%i ~%i ~-1 ~%i\n", marker->startCol, marker->startRow, marker->endCol, marker->endRow, marker->destCol, marker->destRow);
+        return;
+    }
+    fprintf(commands, "/fill ~%i ~-1 ~%i ~%i ~-1 ~%i minecraft:%s\n", marker->startCol, marker->startRow, marker->endCol, marker->endRow, colors[marker->colorKey]);
+}
+
+void writePlan(struct LinkedList *queue, char **colors, uint32_t *pixelKey, char *commandsName, char *pixelColorsName) { /* Writes then frees every marker in the queue. */
+    FILE *commands = fopen(commandsName, "w"), *pixelColors = fopen(pixelColorsName, "w");
+
+    while(!LL_empty(queue)) {
+        fprintf(pixelColors, "%u\n", queue->head->marker->clone ? 0:pixelKey[queue->head->marker->colorKey]);
+        writeCommand(commands, queue->head->marker, colors);
+        free(LL_removeHead(queue));
+    }
+    fclose(commands);
+    fclose(pixelColors);
+}
+
+void writeCommands(struct LinkedList *queue, char **colors, uint32_t *pixelKey) {
+    writePlan(queue, colors, pixelKey, ".\\commands.txt", ".\\pixelColors.txt");
+}
+
+struct Marker* allocQuadMarker(struct Quad *q) {
+    return allocMarker(q->col, q->row, q->col + q->size - 1, q->row + q->size - 1, q->color);
+}
+
+void quad(struct Quad *q, struct LinkedList *queue, int *layers, int limit, int layer) {
+    int i;
+    if(q->color == GRID_EMPTY) /* Nothing but masked pixels, so nothing to place. */
+        return;
+    if(q->size <= limit || q->leaf) {
+        LL_append(queue, allocQuadMarker(q));
+        return;
+    }
+
+    for(i = 0 ; i < 4 ; i++)
+        quad(q->children[i], queue, layers, limit, layer + 1);
+}
+
+int quadWithin(struct Quad *q, struct LinkedList *queue, int nodeBudget) {
+    /* A quad is placed whole once it gets at most 'nodeBudget' pixels wrong. Returns the size of the smallest quad placed. */
+    int i, smallest = q->size, size;
+    if(q->color == GRID_EMPTY)
+        return smallest;
+    if(q->leaf || q->error <= nodeBudget) {
+        LL_append(queue, allocQuadMarker(q));
+        return smallest;
+    }
+
+    for(i = 0 ; i < 4 ; i++)
+        if((size = quadWithin(q->children[i], queue, nodeBudget)) < smallest)
+            smallest = size;
+    return smallest;
+}
+
+int splitGain(struct Quad *q) { /* How many wrong pixels splitting the quad into its children fixes. */
+    return q->error - q->children[0]->error - q->children[1]->error - q->children[2]->error - q->children[3]->error;
+}
+
+int gainBefore(struct Quad *a, struct Quad *b) { /* Biggest gain first, then the most wrong pixels, then the biggest quad. */
+    int ga = splitGain(a), gb = splitGain(b);
+    if(ga != gb)
+        return ga > gb;
+    if(a->error != b->error)
+        return a->error > b->error;
+    return a->size > b->size;
+}
+
+void pushSplit(struct Quad **heap, int *n, struct Quad *q) {
+    int i = (*n)++;
+    while(i > 0 && gainBefore(q, heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = q;
+}
+
+struct Quad* popSplit(struct Quad **heap, int *n) {
+    struct Quad *top = heap[0], *last = heap[--(*n)];
+    int i = 0, child;
+    while((child = 2 * i + 1) < *n) {
+        if(child + 1 < *n && gainBefore(heap[child + 1], heap[child]))
+            child++;
+        if(!gainBefore(heap[child], last))
+            break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if(*n > 0)
+        heap[i] = last;
+    return top;
+}
+
+void placeQuad(struct Quad *q, struct Quad **heap, int *n, struct LinkedList *queue, int *smallest, int limit) {
+    /* Quads that can still be split wait in the heap, the rest are placed right away. */
+    if(q->color == GRID_EMPTY)
+        return;
+    if(!q->leaf && q->error > 0 && q->size > limit) {
+        pushSplit(heap, n, q);
+        return;
+    }
+    LL_append(queue, allocQuadMarker(q));
+    if(q->size < *smallest)
+        *smallest = q->size;
+}
+
+int adaptiveQuad(struct Quad *q, struct LinkedList *queue, int budget, int limit) {
+    /* Starts from the whole quad and keeps splitting the quad that fixes the most pixels, until at most 'budget' pixels are wrong overall.
+    Like quad, quads of size 'limit' or smaller are never split. Returns the size of the smallest quad placed. */
+    struct Quad **heap = malloc(q->size * q->size * sizeof(struct Quad*)), *top;
+    int i, n = 0, smallest = q->size, error = q->color == GRID_EMPTY ? 0:q->error;
+
+    placeQuad(q, heap, &n, queue, &smallest, limit);
+    while(n > 0 && error > budget) {
+        top = popSplit(heap, &n);
+        error -= splitGain(top);
+        for(i = 0 ; i < 4 ; i++)
+            placeQuad(top->children[i], heap, &n, queue, &smallest, limit);
+    }
+    for(i = 0 ; i < n ; i++) {
+        LL_append(queue, allocQuadMarker(heap[i]));
+        if(heap[i]->size < smallest)
+            smallest = heap[i]->size;
+    }
+
+    free(heap);
+    return smallest;
+}
+
+void prioritizeMarkers(struct LinkedList *pq, int *counters, int n) {
+    int i;
+    for(i = 0 ; i < n ; i++) {
+        if(counters[i] == 0)
+            continue;
+        if(LL_empty(pq) || counters[pq->tail->marker->colorKey] >= counters[i])
+            LL_append(pq, allocMarker(0, 0, 0, 0, i));
+        else {
+            struct Node *prev = NULL, *n = pq->head;
+            while(counters[n->marker->colorKey] >= counters[i]) {
+                prev = n;
+                n = n->next;
+            }
+            LL_insert(pq, prev, allocMarker(0, 0, 0, 0, i));
+        }
+    }
+}
+
+int priorityOrder(int *counters, int colors, int *order) { /* Fills 'order' with the colors that appear, in the order they get extracted. */
+    int n = 0;
+    struct LinkedList priorityQueue = {NULL, NULL};
+
+    prioritizeMarkers(&priorityQueue, counters, colors);
+    while(!LL_empty(&priorityQueue)) {
+        order[n++] = priorityQueue.head->marker->colorKey;
+        free(LL_removeHead(&priorityQueue));
+    }
+    return n;
+}
+
+void optimizeCommands(struct LinkedList *queue, int colors, int detail) { /* Replaces the markers in the queue with the bitboard optimizer's rectangles. */
+    struct Grid *grid = allocGrid(128, 128);
+    struct Bitboard *b;
+    int n, *order = malloc(colors * sizeof(int));
+
+    imprintGrid(queue, grid);
+    freeQueue(queue);
+    b = allocBitboard(grid, colors, detail, 0);
+    n = bitboardOrder(b, order);
+    bitboardCommandsParallel(b, order, n, queue);
+
+    freeBitboard(b);
+    freeGrid(grid);
+    free(order);
+}
+
+int queueLength(struct LinkedList *queue) {
+    int length = 0;
+    struct Node *n = queue->head;
+    while(n != NULL) {
+        length++;
+        n = n->next;
+    }
+    return length;
+}
+
+void cloneQueue(struct LinkedList *queue, struct LinkedList *copy) {
+    struct Node *n = queue->head;
+    while(n != NULL) {
+        LL_append(copy, cloneMarker(n->marker));
+        n = n->next;
+    }
+}
+
+void freeQueue(struct LinkedList *queue) {
+    while(!LL_empty(queue))
+        free(LL_removeHead(queue));
+}
\ No newline at end of file
@@ -0,0 +1,41 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: commands.h
+
+Timeline:
+20261019 - File created. Transfered functions over from main file.
+20261019 - Added writeCommands and writePlan.
+20261019 - Added ordered optimization and queue helpers.
+20261019 - Grid functions moved to grid.h.
+20261019 - Optimization is done by the bitboard optimizer.
+20261019 - Added copyRegion for clone markers.
+20261019 - Added quadWithin and adaptiveQuad.
+*/
+
+#ifndef COMMANDS_H
+#define COMMANDS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "linkedList.h"
+#include "quad.h"
+#include "grid.h"
+
+void imprintGrid(struct LinkedList *queue, struct Grid *grid);
+void copyRegion(struct Grid *grid, struct Marker *m);
+void writeCommand(FILE *commands, struct Marker *marker, char **colors);
+void writePlan(struct LinkedList *queue, char **colors, uint32_t *pixelKey, char *commandsName, char *pixelColorsName);
+void writeCommands(struct LinkedList *queue, char **colors, uint32_t *pixelKey);
+struct Marker* allocQuadMarker(struct Quad *q);
+void quad(struct Quad *q, struct LinkedList *queue, int *layers, int limit, int layer);
+int quadWithin(struct Quad *q, struct LinkedList *queue, int nodeBudget);
+int adaptiveQuad(struct Quad *q, struct LinkedList *queue, int budget, int limit);
+int priorityOrder(int *counters, int colors, int *order);
+void optimizeCommands(struct LinkedList *queue, int colors, int detail);
+int queueLength(struct LinkedList *queue);
+void cloneQueue(struct LinkedList *queue, struct LinkedList *copy);
+void freeQueue(struct LinkedList *queue);
+
+#endif
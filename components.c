@@ -0,0 +1,355 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: components.c
+
+Note: The bitboard plans a whole grid one color at a time, and every color has to look at every row. On a big wall most of
+that is islands that have nothing to do with each other. This plans every connected area of one color on its own instead.
+Labelling is a union find over the cells. Each band of COMPONENT_BAND rows is joined up by its own job, only ever touching its own
+cells, then the bands are joined to each other down their edges, and every cell looks up its root in parallel. A root is always
+the first cell of its component, so numbering the roots in one pass over the cells numbers the components top to bottom.
+Components are painted biggest bounding box first. That is the painter's order: something nested inside another component's box
+comes after it, so the bigger one may fill right over it. Each component is planned by the bitboard over its own bounding box,
+where its own cells have to be filled, cells of components painted after it may be filled over, and cells of components
+painted before it are taken out of the remaining cells so nothing covers them. Every pixel ends up the color of the last fill
+over it, which is its own component's. No component depends on another's plan, so they are planned in parallel and joined in order.
+Fills can cover a whole wall here, so any bigger than a /fill may place are cut into bands of rows.
+
+Timeline:
+20261019 - File created.
+20261019 - Components mode stops when the image can not be read instead of planning an empty wall.
+20261019 - componentCommands no longer takes the unused color count.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "components.h"
+#include "bitboard.h"
+#include "commands.h"
+#include "palette.h"
+#include "parallel.h"
+#include "quad.h"
+#include "requantize.h"
+
+struct LabelJobs {
+    struct Grid *grid;
+    int cell;
+    struct ComponentLabels *c;
+    int *parent;
+    uint8_t *colors; /* The color of every cell. */
+};
+
+int findRoot(int *parent, int p) { /* Halves the path on the way up. */
+    while(parent[p] != p) {
+        parent[p] = parent[parent[p]];
+        p = parent[p];
+    }
+    return p;
+}
+
+void unite(int *parent, int a, int b) { /* The lower cell becomes the root, so a root is always the first cell of its component. */
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if(a < b)
+        parent[b] = a;
+    else if(b < a)
+        parent[a] = b;
+}
+
+void labelBandJob(void *context, int band) {
+    struct LabelJobs *l = context;
+    int i, j, p, width = l->c->width, first = band * COMPONENT_BAND, last = first + COMPONENT_BAND;
+
+    if(last > l->c->height)
+        last = l->c->height;
+    for(i = first ; i < last ; i++)
+        for(j = 0 ; j < width ; j++) {
+            p = i * width + j;
+            l->colors[p] = GRID(l->grid, i * l->cell, j * l->cell);
+            l->parent[p] = p;
+            if(l->colors[p] == GRID_EMPTY)
+                continue;
+            if(j > 0 && l->colors[p - 1] == l->colors[p])
+                unite(l->parent, p, p - 1);
+            if(i > first && l->colors[p - width] == l->colors[p])
+                unite(l->parent, p, p - width);
+        }
+}
+
+void rootBandJob(void *context, int band) { /* Nothing changes the parents any more, so the roots can be looked up side by side. */
+    struct LabelJobs *l = context;
+    int p, q, last = (band + 1) * COMPONENT_BAND * l->c->width;
+
+    if(last > l->c->width * l->c->height)
+        last = l->c->width * l->c->height;
+    for(p = band * COMPONENT_BAND * l->c->width ; p < last ; p++) {
+        for(q = p ; l->parent[q] != q ; q = l->parent[q]);
+        l->c->labels[p] = q;
+    }
+}
+
+struct ComponentLabels* labelComponents(struct Grid *grid, int cell) { /* Labels the cells of 'cell' pixels across that are one color and touch. */
+    struct ComponentLabels *c = malloc(sizeof(struct ComponentLabels));
+    struct LabelJobs l;
+    struct Component *k;
+    int i, j, p, capacity = 64, bands, total;
+
+    c->width = grid->width / cell;
+    c->height = grid->height / cell;
+    total = c->width * c->height;
+    c->labels = malloc((total > 0 ? total:1) * sizeof(int));
+    c->components = malloc(capacity * sizeof(struct Component));
+    c->n = 0;
+
+    l.grid = grid;
+    l.cell = cell;
+    l.c = c;
+    l.parent = malloc((total > 0 ? total:1) * sizeof(int));
+    l.colors = malloc(total > 0 ? total:1);
+    bands = (c->height + COMPONENT_BAND - 1) / COMPONENT_BAND;
+
+    parallelFor(bands, labelBandJob, &l);
+    for(i = COMPONENT_BAND ; i < c->height ; i += COMPONENT_BAND) /* Joining the bands down their edges. */
+        for(j = 0 ; j < c->width ; j++) {
+            p = i * c->width + j;
+            if(l.colors[p] != GRID_EMPTY && l.colors[p] == l.colors[p - c->width])
+                unite(l.parent, p, p - c->width);
+        }
+    parallelFor(bands, rootBandJob, &l);
+
+    for(p = 0 ; p < total ; p++) { /* A root comes before the rest of its cells, so its number is known by the time they are. */
+        if(l.colors[p] == GRID_EMPTY) {
+            c->labels[p] = -1;
+            continue;
+        }
+        i = p / c->width;
+        j = p % c->width;
+        if(c->labels[p] == p) {
+            if(c->n == capacity) {
+                capacity *= 2;
+                c->components = realloc(c->components, capacity * sizeof(struct Component));
+            }
+            k = &c->components[c->n];
+            k->color = l.colors[p];
+            k->cells = 0;
+            k->top = k->bottom = i;
+            k->left = k->right = j;
+            l.parent[p] = c->n++; /* Roots are done with their parents, so they hold their component's number instead. */
+        }
+        c->labels[p] = l.parent[c->labels[p]];
+        k = &c->components[c->labels[p]];
+        k->cells++;
+        k->bottom = i; /* Cells come top to bottom, so the last one is the lowest. */
+        k->left = j < k->left ? j:k->left;
+        k->right = j > k->right ? j:k->right;
+    }
+
+    free(l.parent);
+    free(l.colors);
+    return c;
+}
+
+void freeComponentLabels(struct ComponentLabels *c) {
+    free(c->labels);
+    free(c->components);
+    free(c);
+}
+
+struct ComponentOrder {
+    int area; /* Of its bounding box. */
+    int component;
+};
+
+int compareComponentOrder(const void *a, const void *b) { /* Biggest box first, then top to bottom. */
+    const struct ComponentOrder *x = a, *y = b;
+    if(x->area != y->area)
+        return y->area - x->area;
+    return x->component - y->component;
+}
+
+struct ComponentPlans {
+    struct ComponentLabels *c;
+    struct ComponentOrder *order;
+    int *rank; /* By component, where it comes in the painter's order. */
+    int detail;
+    struct LinkedList *plans; /* By rank. */
+};
+
+void planComponentJob(void *context, int k) {
+    struct ComponentPlans *p = context;
+    struct Component *m = &p->c->components[p->order[k].component];
+    struct Grid *box = allocGrid(m->right - m->left + 1, m->bottom - m->top + 1);
+    struct Bitboard *b;
+    struct Node *node;
+    int i, j, l, first = 0;
+
+    for(i = 0 ; i < box->height ; i++) /* 0 is the component, 1 is painted after it and 2 before it. */
+        for(j = 0 ; j < box->width ; j++) {
+            l = p->c->labels[(m->top + i) * p->c->width + m->left + j];
+            GRID(box, i, j) = l < 0 ? GRID_EMPTY:l == p->order[k].component ? 0:p->rank[l] > k ? 1:2;
+        }
+
+    b = allocBitboard(box, 3, 1, 0);
+    for(i = 0 ; i < b->height * b->words ; i++) /* Cells painted before can not be covered. */
+        b->all[i] &= ~BITBOARD_ROW(b, 2, 0)[i];
+    bitboardCommands(b, &first, 1, &p->plans[k]);
+    freeBitboard(b);
+    freeGrid(box);
+
+    for(node = p->plans[k].head ; node != NULL ; node = node->next) { /* From cells of the box to pixels of the grid. */
+        node->marker->colorKey = m->color;
+        node->marker->startCol = (m->left + node->marker->startCol) * p->detail;
+        node->marker->startRow = (m->top + node->marker->startRow) * p->detail;
+        node->marker->endCol = (m->left + node->marker->endCol + 1) * p->detail - 1;
+        node->marker->endRow = (m->top + node->marker->endRow + 1) * p->detail - 1;
+    }
+}
+
+void splitFills(struct LinkedList *plan) { /* Cuts fills over COMPONENT_FILL_LIMIT blocks into bands of rows, in place. */
+    struct LinkedList split = {NULL, NULL};
+    struct Marker *m;
+    int row, rows, width;
+
+    while(!LL_empty(plan)) {
+        m = LL_removeHead(plan);
+        width = m->endCol - m->startCol + 1;
+        if(m->clone || width * (m->endRow - m->startRow + 1) <= COMPONENT_FILL_LIMIT) {
+            LL_append(&split, m);
+            continue;
+        }
+        rows = COMPONENT_FILL_LIMIT / width > 0 ? COMPONENT_FILL_LIMIT / width:1;
+        for(row = m->startRow ; row <= m->endRow ; row += rows)
+            LL_append(&split, allocMarker(m->startCol, row, m->endCol, row + rows - 1 < m->endRow ? row + rows - 1:m->endRow, m->colorKey));
+        free(m);
+    }
+    *plan = split;
+}
+
+int componentCommands(struct Grid *grid, int detail, struct LinkedList *plan, int *components) {
+    /* Appends the plan of the grid, planned component by component, and returns how many commands it has. */
+    struct ComponentPlans p;
+    struct LinkedList placed = {NULL, NULL};
+    int i, k, count;
+
+    p.c = labelComponents(grid, detail);
+    p.detail = detail;
+    p.order = malloc((p.c->n > 0 ? p.c->n:1) * sizeof(struct ComponentOrder));
+    p.rank = malloc((p.c->n > 0 ? p.c->n:1) * sizeof(int));
+    p.plans = calloc(p.c->n > 0 ? p.c->n:1, sizeof(struct LinkedList));
+    for(i = 0 ; i < p.c->n ; i++) {
+        p.order[i].area = (p.c->components[i].right - p.c->components[i].left + 1) * (p.c->components[i].bottom - p.c->components[i].top + 1);
+        p.order[i].component = i;
+    }
+    qsort(p.order, p.c->n, sizeof(struct ComponentOrder), compareComponentOrder);
+    for(k = 0 ; k < p.c->n ; k++)
+        p.rank[p.order[k].component] = k;
+
+    parallelFor(p.c->n, planComponentJob, &p);
+
+    for(k = 0 ; k < p.c->n ; k++) { /* Joined in the painter's order. */
+        if(p.plans[k].head == NULL)
+            continue;
+        if(placed.head == NULL)
+            placed.head = p.plans[k].head;
+        else
+            placed.tail->next = p.plans[k].head;
+        placed.tail = p.plans[k].tail;
+    }
+    splitFills(&placed);
+    count = queueLength(&placed);
+    if(plan->head == NULL)
+        *plan = placed;
+    else if(placed.head != NULL) {
+        plan->tail->next = placed.head;
+        plan->tail = placed.tail;
+    }
+
+    if(components != NULL)
+        *components = p.c->n;
+    freeComponentLabels(p.c);
+    free(p.order);
+    free(p.rank);
+    free(p.plans);
+    return count;
+}
+
+/*
+Plans an image of any size component by component and checks it against the target, the quad of every map at the level of
+detail. The same target is also planned map by map with optimizeCommands to compare against.
+*/
+void componentsMode(char *image, char *key, int detail) {
+    FILE *fr = fopen(image, "rb");
+    struct LinkedList plan = {NULL, NULL}, mapPlan = {NULL, NULL};
+    struct BMPHeader h;
+    struct RGBColor *colors;
+    struct Grid *wall, *target, *check, *map;
+    struct Quad q;
+    LARGE_INTEGER start, end, frequency;
+    uint32_t *pixelKey;
+    char **names;
+    int i, r, n, columns, rows, components, commands, mapCommands = 0;
+    double componentTime, mapTime = 0;
+
+    if(fr == NULL || (n = loadColorKey(key, &names, &colors, &pixelKey)) <= 0) {
+        printf("Components mode could not open %s or the color key %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        return;
+    }
+    h = readBMPHeader(fr);
+    columns = (h.width > 0 ? h.width + 127:128) / 128;
+    rows = ((h.height < 0 ? -h.height:h.height > 0 ? h.height:1) + 127) / 128;
+    wall = allocGrid(columns * 128, rows * 128);
+    if(!decodeQuantize(fr, &h, colors, n, wall, NULL)) {
+        printf("Components mode could not read %s, it needs to be a 24 or 32 bit bmp.\n", image);
+        fclose(fr);
+        freeGrid(wall);
+        freeColorNames(names);
+        free(colors);
+        free(pixelKey);
+        return;
+    }
+    fclose(fr);
+    target = allocGrid(columns * 128, rows * 128);
+    check = allocGrid(columns * 128, rows * 128);
+    map = allocGrid(128, 128);
+    QueryPerformanceFrequency(&frequency);
+
+    for(i = 0 ; i < columns * rows ; i++) { /* The target is what the quad of every map looks like at the level of detail. */
+        for(r = 0 ; r < 128 ; r++)
+            memcpy(&GRID(map, r, 0), &GRID(wall, i / columns * 128 + r, i % columns * 128), 128);
+        q = buildQuadExact(map, n, 128);
+        quad(&q, &mapPlan, NULL, detail, 0);
+        imprintGrid(&mapPlan, map);
+        for(r = 0 ; r < 128 ; r++)
+            memcpy(&GRID(target, i / columns * 128 + r, i % columns * 128), &GRID(map, r, 0), 128);
+        QueryPerformanceCounter(&start);
+        optimizeCommands(&mapPlan, n, detail);
+        QueryPerformanceCounter(&end);
+        mapTime += (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+        mapCommands += queueLength(&mapPlan);
+        freeQueue(&mapPlan);
+        destroyQuad(&q);
+    }
+
+    QueryPerformanceCounter(&start);
+    commands = componentCommands(target, detail, &plan, &components);
+    QueryPerformanceCounter(&end);
+    componentTime = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+    printf("%i by %i maps at detail %i: %i components, %i commands planned by component in %.2f ms, %i planned map by map in %.2f ms.\n",
+        columns, rows, detail, components, commands, componentTime, mapCommands, mapTime);
+
+    imprintGrid(&plan, check);
+    if(!gridsMatch(target, check))
+        printf("ERROR: The components plan does not match the target.\n");
+
+    writeCommands(&plan, names, pixelKey);
+    freeGrid(wall);
+    freeGrid(target);
+    freeGrid(check);
+    freeGrid(map);
+    freeColorNames(names);
+    free(colors);
+    free(pixelKey);
+}
@@ -0,0 +1,42 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: components.h
+
+Timeline:
+20261019 - File created.
+20261019 - componentCommands no longer takes the unused color count.
+*/
+
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include "grid.h"
+#include "linkedList.h"
+
+#define COMPONENT_BAND 32 /* Rows of cells labelled by one job. */
+#define COMPONENT_FILL_LIMIT 32768 /* The most blocks one /fill command may place. */
+
+struct Component { /* Cells of one color that touch, in cells of the level of detail. */
+    int color;
+    int cells;
+    int top;
+    int left;
+    int bottom;
+    int right;
+};
+
+struct ComponentLabels {
+    int width; /* Cells across. */
+    int height;
+    int *labels; /* By cell, the component it is in, -1 for GRID_EMPTY. */
+    struct Component *components;
+    int n;
+};
+
+struct ComponentLabels* labelComponents(struct Grid *grid, int cell);
+void freeComponentLabels(struct ComponentLabels *c);
+int componentCommands(struct Grid *grid, int detail, struct LinkedList *plan, int *components);
+void componentsMode(char *image, char *key, int detail);
+
+#endif
@@ -0,0 +1,517 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: daemon.c
+
+Note: Daemon mode keeps MIMM running and takes conversion jobs over a Unix domain socket, so a pipeline firing off thousands
+of small jobs does not pay for starting the program and reading the color key every time.
+Color keys stay loaded after the first job that uses them and the worker threads are started once.
+
+Every message is a frame: the length of the text as 4 bytes, lowest byte first, then the text itself.
+A connection carries one request and gets one reply.
+    convert <image> <color key> <detail> <format> [output prefix]
+        Detail 0 lets the auto tuner pick. Format 'commands' writes <prefix>commands.txt and <prefix>pixelColors.txt,
+        format 'count' only replies. The reply is "ok <commands> <detail> <ms>" or "error <reason>".
+        When the daemon was started with a cache directory, a plan taken from the cache has " cached" after the time.
+        The latest convert writing an output prefix wins. Older converts that write the same prefix are dropped if they are
+        still waiting, or cancelled if they are running, and reply "cancelled".
+    stats
+        Replies "queue <waiting> active <running> done <jobs> failed <jobs> busy <turned away> cancelled <jobs> p50 <ms> p90 <ms> p99 <ms>".
+        Latencies run from the request being read to the reply being sent, over the latest DAEMON_LATENCIES jobs.
+    stop
+        Finishes the jobs already queued and exits.
+When the queue is full a convert gets "busy <waiting>" straight away instead of waiting, so callers can back off and try again.
+Stats and stop are answered by the thread accepting connections, so they are never stuck behind a full queue.
+That thread waits on the listener and on up to DAEMON_MAX_PENDING connections at once with select, and only reads what has
+arrived, so a client that connects and says nothing holds up nobody. It gets DAEMON_READ_TIMEOUT to send its frame before
+the connection is dropped, or less when that many slow connections are waiting that the oldest has to make room.
+
+Timeline:
+20261019 - File created.
+20261019 - Color keys are loaded with loadColorKey, so built in palettes never touch the disk.
+20261019 - Convert goes through planImage, which takes plans from the plan cache when one is given.
+20261019 - Converts run as jobs. A newer convert to the same output prefix cancels older ones.
+20261019 - Requests are read with a timeout, a silent client used to block every connection after it.
+20261019 - Requests are read with select as they arrive, a silent client no longer holds up the others for the timeout.
+*/
+
+#include <winsock2.h>
+#include <afunix.h>
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "daemon.h"
+#include "cache.h"
+#include "commands.h"
+#include "job.h"
+#include "palette.h"
+#include "parallel.h"
+
+struct DaemonKey { /* A color key loaded by an earlier job. */
+    char path[260];
+    int colors;
+    char **names;
+    struct RGBColor *key;
+    uint32_t *pixelKey;
+};
+
+struct DaemonJob {
+    SOCKET client;
+    char request[DAEMON_MAX_FRAME];
+    LONGLONG start;
+    char target[260]; /* The output prefix of a convert that writes commands. */
+    int writes;
+    int superseded; /* A newer convert writes the same target. */
+};
+
+struct DaemonPending { /* A connection whose request has not all arrived yet. */
+    SOCKET client;
+    unsigned char header[4];
+    char text[DAEMON_MAX_FRAME];
+    int got; /* Bytes of the frame read so far, header included. */
+    int length;
+    DWORD since;
+};
+
+struct DaemonRun { /* What one worker is doing. */
+    struct Job job;
+    char target[260];
+    int writes;
+    int busy;
+};
+
+struct Daemon {
+    CRITICAL_SECTION lock; /* Guards everything below except the keys. */
+    CONDITION_VARIABLE ready;
+    struct DaemonJob *queue; /* Ring of waiting jobs. */
+    int capacity;
+    int head;
+    int waiting;
+    int active;
+    int stopping;
+    long done;
+    long failed;
+    long busy;
+    long cancelled;
+    struct DaemonRun *runs; /* One for every worker. */
+    int workers;
+    volatile LONG started; /* Workers that have taken their run. */
+    double latencies[DAEMON_LATENCIES]; /* Milliseconds, a ring of the latest jobs. */
+    long latencyCount;
+    LONGLONG frequency;
+    CRITICAL_SECTION keyLock;
+    struct DaemonKey keys[DAEMON_MAX_KEYS];
+    int keyCount;
+    struct PlanCache *cache; /* NULL when plans are not cached. */
+    struct PlanCache cacheSettings;
+};
+
+LONGLONG daemonClock() {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+int transfer(SOCKET s, char *buffer, int length, int sending) { /* Sends or receives exactly 'length' bytes, returns 0 if the connection failed. */
+    int done = 0, result;
+    while(done < length) {
+        result = sending ? send(s, buffer + done, length - done, 0):recv(s, buffer + done, length - done, 0);
+        if(result <= 0)
+            return 0;
+        done += result;
+    }
+    return 1;
+}
+
+int readMessage(SOCKET s, char *text) { /* Reads one frame into 'text' (DAEMON_MAX_FRAME bytes), returns 0 if it could not. */
+    unsigned char header[4];
+    int length;
+
+    if(!transfer(s, (char*)header, 4, 0))
+        return 0;
+    length = header[0] | header[1] << 8 | header[2] << 16 | header[3] << 24;
+    if(length < 0 || length >= DAEMON_MAX_FRAME || !transfer(s, text, length, 0))
+        return 0;
+    text[length] = '\0';
+    return 1;
+}
+
+int readPending(struct DaemonPending *p) {
+    /* Reads whatever of the frame has arrived without waiting for more. Returns 1 once it is whole, 0 while it is not yet
+    and -1 if it never will be. Only called when select says the connection is readable, so recv does not block. */
+    int result;
+
+    if(p->got < 4)
+        result = recv(p->client, (char*)p->header + p->got, 4 - p->got, 0);
+    else
+        result = recv(p->client, p->text + p->got - 4, p->length - (p->got - 4), 0);
+    if(result <= 0)
+        return -1;
+    p->got += result;
+    if(p->got == 4) {
+        p->length = p->header[0] | p->header[1] << 8 | p->header[2] << 16 | p->header[3] << 24;
+        if(p->length < 0 || p->length >= DAEMON_MAX_FRAME)
+            return -1;
+    }
+    if(p->got < 4 || p->got - 4 < p->length)
+        return 0;
+    p->text[p->length] = '\0';
+    return 1;
+}
+
+int sendMessage(SOCKET s, char *text) {
+    unsigned char header[4];
+    int length = strlen(text);
+
+    header[0] = length & 0xFF;
+    header[1] = (length >> 8) & 0xFF;
+    header[2] = (length >> 16) & 0xFF;
+    header[3] = (length >> 24) & 0xFF;
+    return transfer(s, (char*)header, 4, 1) && transfer(s, text, length, 1);
+}
+
+struct DaemonKey* daemonKey(struct Daemon *d, char *path) { /* Loads the color key the first time it is asked for, returns NULL if it can not. */
+    struct DaemonKey *k = NULL;
+    int i;
+
+    EnterCriticalSection(&d->keyLock);
+    for(i = 0 ; i < d->keyCount && k == NULL ; i++)
+        if(strcmp(d->keys[i].path, path) == 0)
+            k = &d->keys[i];
+
+    if(k == NULL && d->keyCount < DAEMON_MAX_KEYS && strlen(path) < sizeof(k->path)) {
+        k = &d->keys[d->keyCount];
+        if((k->colors = loadColorKey(path, &k->names, &k->key, &k->pixelKey)) > 0) {
+            strcpy(k->path, path);
+            d->keyCount++;
+        }
+        else
+            k = NULL;
+    }
+    LeaveCriticalSection(&d->keyLock);
+    return k;
+}
+
+int daemonConvert(struct Daemon *d, char *request, char *reply, LONGLONG start) { /* Runs a convert request and writes the reply, returns 0 if it failed and 2 if it was cancelled. */
+    char image[260], key[260], format[16], prefix[260] = "", commandsName[300], pixelColorsName[300];
+    struct LinkedList plan = {NULL, NULL};
+    struct DaemonKey *k;
+    struct Grid *grid;
+    int detail, commands, hit;
+
+    if(sscanf(request, "%*s %259s %259s %i %15s %259s", image, key, &detail, format, prefix) < 4
+        || (strcmp(format, "commands") != 0 && strcmp(format, "count") != 0)) {
+        sprintf(reply, "error usage: convert <image> <color key> <detail> <commands|count> [output prefix]");
+        return 0;
+    }
+    if((k = daemonKey(d, key)) == NULL) {
+        sprintf(reply, "error could not load color key %s", key);
+        return 0;
+    }
+
+    grid = allocGrid(128, 128);
+    if((detail = planImage(d->cache, image, k->key, k->colors, detail, &plan, grid, &hit)) == 0) {
+        sprintf(reply, "error could not open or read %s", image);
+        freeGrid(grid);
+        return 0;
+    }
+    if(jobCancelled()) { /* A newer convert writes the same files. */
+        sprintf(reply, "cancelled");
+        freeQueue(&plan);
+        freeGrid(grid);
+        return 2;
+    }
+    commands = queueLength(&plan);
+
+    if(strcmp(format, "commands") == 0) {
+        sprintf(commandsName, "%scommands.txt", prefix);
+        sprintf(pixelColorsName, "%spixelColors.txt", prefix);
+        writePlan(&plan, k->names, k->pixelKey, commandsName, pixelColorsName);
+    }
+    else
+        freeQueue(&plan);
+
+    sprintf(reply, "ok %i %i %.2f%s", commands, detail, (daemonClock() - start) * 1000.0 / d->frequency, hit ? " cached":"");
+    freeGrid(grid);
+    return 1;
+}
+
+int compareLatency(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+void daemonStats(struct Daemon *d, char *reply) {
+    double sorted[DAEMON_LATENCIES], p50 = 0, p90 = 0, p99 = 0;
+    int n;
+
+    EnterCriticalSection(&d->lock);
+    n = d->latencyCount < DAEMON_LATENCIES ? d->latencyCount:DAEMON_LATENCIES;
+    memcpy(sorted, d->latencies, n * sizeof(double));
+    sprintf(reply, "queue %i active %i done %li failed %li busy %li cancelled %li", d->waiting, d->active, d->done, d->failed, d->busy, d->cancelled);
+    LeaveCriticalSection(&d->lock);
+
+    if(n > 0) {
+        qsort(sorted, n, sizeof(double), compareLatency);
+        p50 = sorted[(n - 1) * 50 / 100];
+        p90 = sorted[(n - 1) * 90 / 100];
+        p99 = sorted[(n - 1) * 99 / 100];
+    }
+    sprintf(reply + strlen(reply), " p50 %.2f p90 %.2f p99 %.2f", p50, p90, p99);
+}
+
+DWORD WINAPI daemonWorker(LPVOID param) {
+    struct Daemon *d = param;
+    struct DaemonRun *run = &d->runs[InterlockedIncrement(&d->started) - 1];
+    struct DaemonJob job;
+    struct Job *previous;
+    char reply[DAEMON_MAX_FRAME];
+    int ok;
+
+    while(1) {
+        EnterCriticalSection(&d->lock);
+        while(d->waiting == 0 && !d->stopping)
+            SleepConditionVariableCS(&d->ready, &d->lock, INFINITE);
+        if(d->waiting == 0) { /* Stopping and nothing left to do. */
+            LeaveCriticalSection(&d->lock);
+            return 0;
+        }
+        job = d->queue[d->head];
+        d->head = (d->head + 1) % d->capacity;
+        d->waiting--;
+        d->active++;
+        initJob(&run->job, NULL, NULL);
+        strcpy(run->target, job.target);
+        run->writes = job.writes;
+        run->busy = 1;
+        LeaveCriticalSection(&d->lock);
+
+        if(job.superseded) { /* Dropped before it started. */
+            sprintf(reply, "cancelled");
+            ok = 2;
+        }
+        else {
+            previous = beginJob(&run->job);
+            ok = daemonConvert(d, job.request, reply, job.start);
+            endJob(previous);
+        }
+        sendMessage(job.client, reply);
+        closesocket(job.client);
+
+        EnterCriticalSection(&d->lock);
+        d->active--;
+        run->busy = 0;
+        if(ok == 2)
+            d->cancelled++;
+        else if(ok)
+            d->done++;
+        else
+            d->failed++;
+        d->latencies[d->latencyCount++ % DAEMON_LATENCIES] = (daemonClock() - job.start) * 1000.0 / d->frequency;
+        LeaveCriticalSection(&d->lock);
+    }
+}
+
+void supersede(struct Daemon *d, char *target) { /* Drops or cancels every older convert writing 'target'. Called with the lock held. */
+    int i;
+    for(i = 0 ; i < d->waiting ; i++) {
+        struct DaemonJob *job = &d->queue[(d->head + i) % d->capacity];
+        if(job->writes && strcmp(job->target, target) == 0)
+            job->superseded = 1;
+    }
+    for(i = 0 ; i < d->workers ; i++)
+        if(d->runs[i].busy && d->runs[i].writes && strcmp(d->runs[i].target, target) == 0)
+            cancelJob(&d->runs[i].job);
+}
+
+SOCKET unixSocket(char *socketPath, SOCKADDR_UN *address) {
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    strncpy(address->sun_path, socketPath, sizeof(address->sun_path) - 1);
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+int takeRequest(struct Daemon *d, SOCKET client, char *request) {
+    /* Answers stats and stop, queues a convert or turns it away as busy. Returns 0 once the daemon has been told to stop. */
+    char reply[DAEMON_MAX_FRAME], command[16], format[16];
+    LONGLONG start = daemonClock();
+
+    if(sscanf(request, "%15s", command) != 1) {
+        closesocket(client);
+        return 1;
+    }
+    if(strcmp(command, "stats") == 0)
+        daemonStats(d, reply);
+    else if(strcmp(command, "stop") == 0) {
+        sendMessage(client, "ok stopping");
+        closesocket(client);
+        return 0;
+    }
+    else if(strcmp(command, "convert") == 0) {
+        EnterCriticalSection(&d->lock);
+        if(d->waiting < d->capacity) {
+            struct DaemonJob *job = &d->queue[(d->head + d->waiting) % d->capacity];
+            job->client = client;
+            job->start = start;
+            strcpy(job->request, request);
+            job->target[0] = '\0';
+            job->writes = sscanf(request, "%*s %*s %*s %*s %15s %259s", format, job->target) >= 1 && strcmp(format, "commands") == 0;
+            job->superseded = 0;
+            if(job->writes)
+                supersede(d, job->target);
+            d->waiting++;
+            WakeConditionVariable(&d->ready);
+            client = INVALID_SOCKET; /* The worker replies and closes it. */
+        }
+        else {
+            d->busy++;
+            sprintf(reply, "busy %i", d->waiting);
+        }
+        LeaveCriticalSection(&d->lock);
+        if(client == INVALID_SOCKET)
+            return 1;
+    }
+    else
+        sprintf(reply, "error unknown request %s", command);
+
+    sendMessage(client, reply);
+    closesocket(client);
+    return 1;
+}
+
+void daemonMode(char *socketPath, int workers, int queueLimit, char *cacheDir, int cacheMegabytes) {
+    struct Daemon *d = calloc(1, sizeof(struct Daemon));
+    struct DaemonPending *pending = malloc(DAEMON_MAX_PENDING * sizeof(struct DaemonPending));
+    char reply[DAEMON_MAX_FRAME];
+    HANDLE *handles;
+    SOCKADDR_UN address;
+    SOCKET listener, client, highest;
+    LARGE_INTEGER frequency;
+    WSADATA wsa;
+    fd_set readable;
+    struct timeval wait;
+    int i, oldest, waiting = 0, running = 1;
+
+    if(workers <= 0)
+        workers = parallelThreads();
+    if(queueLimit <= 0)
+        queueLimit = DAEMON_DEFAULT_QUEUE;
+
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+    DeleteFileA(socketPath); /* A socket file left behind by a daemon that did not stop cleanly. */
+    listener = unixSocket(socketPath, &address);
+    if(listener == INVALID_SOCKET || bind(listener, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR || listen(listener, SOMAXCONN) == SOCKET_ERROR) {
+        printf("Daemon mode could not listen on %s.\n", socketPath);
+        if(listener != INVALID_SOCKET)
+            closesocket(listener);
+        WSACleanup();
+        free(pending);
+        free(d);
+        return;
+    }
+
+    QueryPerformanceFrequency(&frequency);
+    d->frequency = frequency.QuadPart;
+    d->capacity = queueLimit;
+    if(cacheDir != NULL && cacheDir[0] != '\0') {
+        cacheOpen(&d->cacheSettings, cacheDir, cacheMegabytes);
+        d->cache = &d->cacheSettings;
+    }
+    d->queue = malloc(queueLimit * sizeof(struct DaemonJob));
+    InitializeCriticalSection(&d->lock);
+    InitializeCriticalSection(&d->keyLock);
+    InitializeConditionVariable(&d->ready);
+    d->workers = workers;
+    d->runs = calloc(workers, sizeof(struct DaemonRun));
+    handles = malloc(workers * sizeof(HANDLE));
+    for(i = 0 ; i < workers ; i++)
+        handles[i] = CreateThread(NULL, 0, daemonWorker, d, 0, NULL);
+    printf("Daemon listening on %s with %i workers%s%s.\n", socketPath, workers, d->cache != NULL ? ", caching plans in ":"", d->cache != NULL ? d->cache->dir:"");
+
+    while(running) {
+        FD_ZERO(&readable);
+        highest = listener;
+        FD_SET(listener, &readable);
+        for(i = 0 ; i < waiting ; i++) {
+            FD_SET(pending[i].client, &readable);
+            highest = pending[i].client > highest ? pending[i].client:highest;
+        }
+        wait.tv_sec = 0;
+        wait.tv_usec = DAEMON_POLL * 1000;
+        if(select((int)highest + 1, &readable, NULL, NULL, &wait) == SOCKET_ERROR)
+            continue;
+
+        if(FD_ISSET(listener, &readable) && (client = accept(listener, NULL, NULL)) != INVALID_SOCKET) {
+            if(waiting == DAEMON_MAX_PENDING) { /* Full of slow connections, the one that has had the longest makes room. */
+                for(i = 1, oldest = 0 ; i < waiting ; i++)
+                    if(GetTickCount() - pending[i].since > GetTickCount() - pending[oldest].since)
+                        oldest = i;
+                closesocket(pending[oldest].client);
+                pending[oldest] = pending[--waiting];
+            }
+            pending[waiting].client = client;
+            pending[waiting].got = 0;
+            pending[waiting].since = GetTickCount();
+            waiting++;
+        }
+        for(i = waiting - 1 ; i >= 0 && running ; i--) {
+            int state = FD_ISSET(pending[i].client, &readable) ? readPending(&pending[i]):0;
+            if(state == 0 && GetTickCount() - pending[i].since < DAEMON_READ_TIMEOUT)
+                continue;
+            if(state == 1)
+                running = takeRequest(d, pending[i].client, pending[i].text);
+            else /* Gone, sent a bad frame or took too long to send it. */
+                closesocket(pending[i].client);
+            pending[i] = pending[--waiting];
+        }
+    }
+    for(i = 0 ; i < waiting ; i++) /* Connections still sending when the daemon was told to stop. */
+        closesocket(pending[i].client);
+
+    EnterCriticalSection(&d->lock);
+    d->stopping = 1;
+    WakeAllConditionVariable(&d->ready);
+    LeaveCriticalSection(&d->lock);
+    WaitForMultipleObjects(workers, handles, TRUE, INFINITE);
+    for(i = 0 ; i < workers ; i++)
+        CloseHandle(handles[i]);
+
+    daemonStats(d, reply);
+    printf("Daemon stopped: %s\n", reply);
+    closesocket(listener);
+    DeleteFileA(socketPath);
+    WSACleanup();
+
+    for(i = 0 ; i < d->keyCount ; i++) {
+        freeColorNames(d->keys[i].names);
+        free(d->keys[i].key);
+        free(d->keys[i].pixelKey);
+    }
+    DeleteCriticalSection(&d->lock);
+    DeleteCriticalSection(&d->keyLock);
+    free(handles);
+    free(pending);
+    free(d->runs);
+    free(d->queue);
+    free(d);
+}
+
+void daemonRequest(char *socketPath, char *request) { /* Sends one request to a running daemon and prints the reply. */
+    char reply[DAEMON_MAX_FRAME];
+    SOCKADDR_UN address;
+    SOCKET s;
+    WSADATA wsa;
+
+    WSAStartup(MAKEWORD(2, 2), &wsa);
+    s = unixSocket(socketPath, &address);
+    if(s == INVALID_SOCKET || connect(s, (struct sockaddr*)&address, sizeof(address)) == SOCKET_ERROR)
+        printf("Could not connect to a daemon on %s.\n", socketPath);
+    else if(!sendMessage(s, request) || !readMessage(s, reply))
+        printf("The daemon on %s did not reply.\n", socketPath);
+    else
+        printf("%s\n", reply);
+
+    if(s != INVALID_SOCKET)
+        closesocket(s);
+    WSACleanup();
+}
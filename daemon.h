@@ -0,0 +1,27 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: daemon.h
+
+Timeline:
+20261019 - File created.
+20261019 - daemonMode takes a plan cache directory.
+20261019 - Added DAEMON_READ_TIMEOUT.
+20261019 - Added DAEMON_MAX_PENDING and DAEMON_POLL.
+*/
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#define DAEMON_DEFAULT_QUEUE 64 /* Jobs waiting for a worker before new jobs are turned away as busy. */
+#define DAEMON_MAX_FRAME 4096 /* Longest request or reply in bytes. */
+#define DAEMON_MAX_KEYS 32 /* Color keys kept loaded. */
+#define DAEMON_LATENCIES 1024 /* How many of the latest jobs the latency percentiles are taken from. */
+#define DAEMON_READ_TIMEOUT 2000 /* Milliseconds a client has to send its request. */
+#define DAEMON_MAX_PENDING 32 /* Connections whose requests are being read at once, under the 64 sockets select takes. */
+#define DAEMON_POLL 100 /* Milliseconds select waits before slow connections are checked for the timeout. */
+
+void daemonMode(char *socketPath, int workers, int queueLimit, char *cacheDir, int cacheMegabytes);
+void daemonRequest(char *socketPath, char *request);
+
+#endif
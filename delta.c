@@ -0,0 +1,198 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: delta.c
+
+Note: Delta mode turns a map that is already placed into a new one without replaying the whole thing.
+The previous map can be given as the commands.txt it was placed with, or as the bmp it was made from.
+Only the pixels that changed need a command. A fill may still run over pixels that did not change,
+as long as the pixel already has the color of the fill, which lets the rectangles grow past the changes.
+Since no fill ever covers a pixel with a color other than its new color, the order of the fills does not matter.
+
+Timeline:
+20261019 - File created.
+20261019 - Uses the new contiguous grid.
+20261019 - readPlanGrid reads /clone commands.
+20261019 - Masked pixels of the new map (GRID_EMPTY) never need a command and fills may run over them.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <string.h>
+#include "delta.h"
+#include "commands.h"
+#include "palette.h"
+
+int colorIndex(char **colors, char *name) {
+    int i;
+    for(i = 0 ; colors[i] != NULL ; i++)
+        if(strcmp(colors[i], name) == 0)
+            return i;
+    return GRID_EMPTY; /* A block that is not in the key can never match the new image, so it always counts as changed. */
+}
+
+int readPlanGrid(FILE *plan, char **colors, struct Grid *grid) { /* Imprints every fill and clone command of a plan onto the grid, returns how many were read. */
+    struct LinkedList queue = {NULL, NULL};
+    char command[512], block[256];
+    int startCol, startRow, endCol, endRow, destCol, destRow, count = 0;
+
+    while(fgets(command, 512, plan)) {
+        if(sscanf(command, "/clone ~%i ~-1 ~%i ~%i ~-1 ~%i ~%i ~-1 ~%i", &startCol, &startRow, &endCol, &endRow, &destCol, &destRow) == 6) {
+            LL_append(&queue, allocCloneMarker(startCol, startRow, endCol, endRow, destCol, destRow));
+            count++;
+            continue;
+        }
+        if(sscanf(command, "/fill ~%i ~-1 ~%i ~%i ~-1 ~%i minecraft:%255s", &startCol, &startRow, &endCol, &endRow, block) != 5)
+            continue;
+        LL_append(&queue, allocMarker(startCol, startRow, endCol, endRow, colorIndex(colors, block)));
+        count++;
+    }
+
+    imprintGrid(&queue, grid);
+    freeQueue(&queue);
+    return count;
+}
+
+int changedPixels(struct Grid *oldGrid, struct Grid *newGrid) {
+    return countMismatches(newGrid, oldGrid);
+}
+
+int rowAllowed(struct Grid *newGrid, int row, int startCol, int endCol, int color) {
+    int j;
+    for(j = startCol ; j <= endCol ; j++)
+        if(GRID(newGrid, row, j) != color && GRID(newGrid, row, j) != GRID_EMPTY)
+            return 0;
+    return 1;
+}
+
+int colAllowed(struct Grid *newGrid, int col, int startRow, int endRow, int color) {
+    int i;
+    for(i = startRow ; i <= endRow ; i++)
+        if(GRID(newGrid, i, col) != color && GRID(newGrid, i, col) != GRID_EMPTY)
+            return 0;
+    return 1;
+}
+
+int uncoveredChanges(struct Grid *oldGrid, struct Grid *newGrid, char covered[128][128], int startCol, int startRow, int endCol, int endRow) {
+    int i, j, count = 0;
+    for(i = startRow ; i <= endRow ; i++)
+        for(j = startCol ; j <= endCol ; j++)
+            if(!covered[i][j] && GRID(newGrid, i, j) != GRID_EMPTY && GRID(oldGrid, i, j) != GRID(newGrid, i, j))
+                count++;
+    return count;
+}
+
+/*
+Greedy rectangle cover of the changed pixels. Every changed pixel that is not covered yet starts a rectangle.
+The rectangle is grown once going right then down, and once going down then right, and whichever covers more changes is kept.
+Edges with no uncovered changes are trimmed back off so no more blocks are placed than needed.
+*/
+void deltaCommands(struct Grid *oldGrid, struct Grid *newGrid, struct LinkedList *plan) {
+    char covered[128][128];
+    int i, j, k;
+
+    memset(covered, 0, sizeof(covered));
+
+    for(i = 0 ; i < 128 ; i++) {
+        for(j = 0 ; j < 128 ; j++) {
+            int color = GRID(newGrid, i, j), right, bottom, hRight, hBottom, vRight, vBottom;
+            if(covered[i][j] || color == GRID_EMPTY || GRID(oldGrid, i, j) == color)
+                continue;
+
+            hRight = j; /* Right then down. */
+            while(hRight + 1 < 128 && colAllowed(newGrid, hRight + 1, i, i, color))
+                hRight++;
+            hBottom = i;
+            while(hBottom + 1 < 128 && rowAllowed(newGrid, hBottom + 1, j, hRight, color))
+                hBottom++;
+
+            vBottom = i; /* Down then right. */
+            while(vBottom + 1 < 128 && rowAllowed(newGrid, vBottom + 1, j, j, color))
+                vBottom++;
+            vRight = j;
+            while(vRight + 1 < 128 && colAllowed(newGrid, vRight + 1, i, vBottom, color))
+                vRight++;
+
+            if(uncoveredChanges(oldGrid, newGrid, covered, j, i, vRight, vBottom) > uncoveredChanges(oldGrid, newGrid, covered, j, i, hRight, hBottom)) {
+                right = vRight;
+                bottom = vBottom;
+            }
+            else {
+                right = hRight;
+                bottom = hBottom;
+            }
+
+            while(right > j && uncoveredChanges(oldGrid, newGrid, covered, right, i, right, bottom) == 0)
+                right--;
+            while(bottom > i && uncoveredChanges(oldGrid, newGrid, covered, j, bottom, right, bottom) == 0)
+                bottom--;
+
+            for(k = i ; k <= bottom ; k++)
+                memset(&covered[k][j], 1, right - j + 1);
+
+            LL_append(plan, allocMarker(j, i, right, bottom, color));
+        }
+    }
+}
+
+void deltaMode(char *previous, char *image, char *key) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r"), *fp = fopen(previous, "rb");
+    struct LinkedList plan = {NULL, NULL};
+    int n, changed;
+    struct Grid *oldGrid, *newGrid, *check;
+    char **colors;
+    uint32_t *pixelKey;
+    size_t length = strlen(previous);
+
+    if(fr == NULL || colorKey == NULL || fp == NULL) {
+        printf("Delta mode could not open %s, %s or %s.\n", previous, image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        if(fp != NULL)
+            fclose(fp);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        fclose(fp);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    oldGrid = allocGrid(128, 128);
+    newGrid = allocGrid(128, 128);
+    check = allocGrid(128, 128);
+
+    if(length > 4 && strcmp(previous + length - 4, ".bmp") == 0) /* The previous map is an image, so quantize it the same way. */
+        quantizeImage(fp, colorKey, oldGrid, NULL);
+    else
+        printf("Read %i commands from %s\n", readPlanGrid(fp, colors, oldGrid), previous);
+    quantizeImage(fr, colorKey, newGrid, NULL);
+
+    changed = changedPixels(oldGrid, newGrid);
+    deltaCommands(oldGrid, newGrid, &plan);
+    printf("Changed pixels: %i (%.1f%%), delta commands: %i\n", changed, changed * 100.0 / (128 * 128), queueLength(&plan));
+
+    imprintGrid(&plan, check); /* Making sure the old map with the delta placed on top really is the new map. */
+    for(n = 0 ; n < 128 * 128 ; n++)
+        if(GRID(check, n / 128, n % 128) == GRID_EMPTY)
+            GRID(check, n / 128, n % 128) = GRID(oldGrid, n / 128, n % 128);
+    if(!gridsMatch(newGrid, check))
+        printf("ERROR: The delta commands do not produce the new image.\n");
+
+    writeCommands(&plan, colors, pixelKey);
+    freeGrid(oldGrid);
+    freeGrid(newGrid);
+    freeGrid(check);
+    freeColorNames(colors);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+    fclose(fp);
+}
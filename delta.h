@@ -0,0 +1,23 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: delta.h
+
+Timeline:
+20261019 - File created.
+20261019 - Uses the new contiguous grid.
+*/
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdio.h>
+#include "linkedList.h"
+#include "grid.h"
+
+int readPlanGrid(FILE *plan, char **colors, struct Grid *grid);
+int changedPixels(struct Grid *oldGrid, struct Grid *newGrid);
+void deltaCommands(struct Grid *oldGrid, struct Grid *newGrid, struct LinkedList *plan);
+void deltaMode(char *previous, char *image, char *key);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: genPalettes.c
+
+Note: A small program run by MIMM.bat before MIMM is compiled. It turns the bundled color keys into builtinPalettes.c,
+so those keys are compiled in and never read from a file. Every palette also gets its own matcher, picked by the shape of the palette:
+    Two colors: a threshold. How much closer a channel value is to the first color than the second is looked up for each channel,
+    and the second color wins when the three add up to more than 0. Pure black and white is just a threshold on the sum of the channels.
+    Near gray: the colors are sorted by the sum of their channels. Since the distance to a color is never less than the difference
+    of the sums, the search starts at the pixel's sum in a lookup table and walks outwards until no color left can be closer.
+    Up to 64 colors: 8 colors are scored at a time with SSE2. The score packs the distance above the index, so the smallest
+    score is the closest color with ties going to the earlier line. Without SSE2 the scan is unrolled instead.
+    More than 64 colors: the unrolled scan.
+Every matcher gives the same color as matchColorIndex.
+
+Usage: genPalettes.exe <output file> <color key csv>...
+
+Timeline:
+20261019 - File created.
+20261019 - The generated matchers mark key and n as unused.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GEN_MAX_COLORS 255
+#define GEN_GRAY_CHROMA 32 /* The most any channel of a near gray palette may stray from the others. */
+#define GEN_SIMD_COLORS 64 /* The index takes the low 6 bits of the score. */
+
+struct GenPalette {
+    char file[128]; /* Name of the csv without the folders. */
+    char name[128]; /* Used to name everything generated for the palette. */
+    int colors;
+    int rgb[GEN_MAX_COLORS][3];
+    char blocks[GEN_MAX_COLORS][128];
+};
+
+int readPalette(char *path, struct GenPalette *p) {
+    FILE *fr = fopen(path, "r");
+    char *file = path, *c;
+    int i;
+
+    if(fr == NULL)
+        return 0;
+
+    for(c = path ; *c != '\0' ; c++)
+        if(*c == '\\' || *c == '/')
+            file = c + 1;
+    strncpy(p->file, file, sizeof(p->file) - 1);
+    p->file[sizeof(p->file) - 1] = '\0';
+    strcpy(p->name, p->file);
+    if((c = strrchr(p->name, '.')) != NULL)
+        *c = '\0';
+    for(c = p->name ; *c != '\0' ; c++)
+        if(!(*c >= 'a' && *c <= 'z') && !(*c >= 'A' && *c <= 'Z') && !(*c >= '0' && *c <= '9'))
+            *c = '_';
+
+    p->colors = 0;
+    while(p->colors < GEN_MAX_COLORS && fscanf(fr, "%i,%i,%i,%127s", &p->rgb[p->colors][0], &p->rgb[p->colors][1], &p->rgb[p->colors][2], p->blocks[p->colors]) == 4)
+        p->colors++;
+    fclose(fr);
+
+    for(i = 0 ; i < p->colors ; i++) /* Stored in 8 bits at runtime, same as getKeyColors. */
+        p->rgb[i][0] &= 0xFF, p->rgb[i][1] &= 0xFF, p->rgb[i][2] &= 0xFF;
+    return p->colors > 0;
+}
+
+int isGray(int *rgb, int value) {
+    return rgb[0] == value && rgb[1] == value && rgb[2] == value;
+}
+
+int chroma(int *rgb) {
+    int high = rgb[0], low = rgb[0], i;
+    for(i = 1 ; i < 3 ; i++) {
+        if(rgb[i] > high)
+            high = rgb[i];
+        if(rgb[i] < low)
+            low = rgb[i];
+    }
+    return high - low;
+}
+
+int sum(int *rgb) {
+    return rgb[0] + rgb[1] + rgb[2];
+}
+
+void writeUnused(FILE *fw) { /* Every matcher takes the key and its size, the generated ones have the key built in. */
+    fprintf(fw, "    (void)key;\n    (void)n;\n");
+}
+
+void writeTwoColors(FILE *fw, struct GenPalette *p) {
+    int *c0 = p->rgb[0], *c1 = p->rgb[1], channel, x;
+
+    if((isGray(c0, 0) && isGray(c1, 255)) || (isGray(c0, 255) && isGray(c1, 0))) { /* The distances are the sum and 765 minus the sum, which never tie. */
+        fprintf(fw, "int %s_match(struct RGBColor c, struct RGBColor *key, int n) { /* Black and white. */\n", p->name);
+    writeUnused(fw);
+        fprintf(fw, "    return c.r + c.g + c.b <= 382 ? %i:%i;\n}\n\n", isGray(c0, 0) ? 0:1, isGray(c0, 0) ? 1:0);
+        return;
+    }
+
+    fprintf(fw, "static const short %s_steps[3][256] = { /* Distance to the first color minus distance to the second, per channel. */", p->name);
+    for(channel = 0 ; channel < 3 ; channel++) {
+        fprintf(fw, "%s{", channel ? ",\n    ":"\n    ");
+        for(x = 0 ; x < 256 ; x++)
+            fprintf(fw, "%s%s%i", x ? ",":"", x % 32 == 0 ? "\n        ":" ", abs(x - c0[channel]) - abs(x - c1[channel]));
+        fprintf(fw, "\n    }");
+    }
+    fprintf(fw, "\n};\n\n");
+    fprintf(fw, "int %s_match(struct RGBColor c, struct RGBColor *key, int n) { /* Two colors, ties go to the first. */\n", p->name);
+    writeUnused(fw);
+    fprintf(fw, "    return %s_steps[0][c.r] + %s_steps[1][c.g] + %s_steps[2][c.b] > 0;\n}\n\n", p->name, p->name, p->name);
+}
+
+void writeUnrolled(FILE *fw, struct GenPalette *p) {
+    int i;
+
+    fprintf(fw, "    int d, best = abs(c.r - %i) + abs(c.g - %i) + abs(c.b - %i), index = 0;\n", p->rgb[0][0], p->rgb[0][1], p->rgb[0][2]);
+    for(i = 1 ; i < p->colors ; i++) {
+        fprintf(fw, "    d = abs(c.r - %i) + abs(c.g - %i) + abs(c.b - %i);\n", p->rgb[i][0], p->rgb[i][1], p->rgb[i][2]);
+        fprintf(fw, "    if(d < best) { best = d; index = %i; }\n", i);
+    }
+    writeUnused(fw);
+    fprintf(fw, "    return index;\n");
+}
+
+void writeSorted(FILE *fw, struct GenPalette *p) {
+    int order[GEN_MAX_COLORS], i, j, s, position = 0;
+
+    for(i = 0 ; i < p->colors ; i++)
+        order[i] = i;
+    for(i = 1 ; i < p->colors ; i++) /* Insertion sort by sum, keeping the line order for equal sums. */
+        for(j = i ; j > 0 && sum(p->rgb[order[j - 1]]) > sum(p->rgb[order[j]]) ; j--) {
+            int swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+        }
+
+    fprintf(fw, "static const int %s_order[%i] = {", p->name, p->colors);
+    for(i = 0 ; i < p->colors ; i++)
+        fprintf(fw, "%s%i", i ? ", ":"", order[i]);
+    fprintf(fw, "};\nstatic const int %s_sums[%i] = {", p->name, p->colors);
+    for(i = 0 ; i < p->colors ; i++)
+        fprintf(fw, "%s%i", i ? ", ":"", sum(p->rgb[order[i]]));
+    fprintf(fw, "};\nstatic const unsigned char %s_start[766] = { /* First sorted color with a sum of at least the index. */", p->name);
+    for(s = 0 ; s <= 765 ; s++) {
+        while(position < p->colors && sum(p->rgb[order[position]]) < s)
+            position++;
+        fprintf(fw, "%s%s%i", s ? ",":"", s % 32 == 0 ? "\n    ":" ", position);
+    }
+    fprintf(fw, "\n};\n\n");
+
+    fprintf(fw, "int %s_match(struct RGBColor c, struct RGBColor *key, int n) { /* Near gray, searched outwards from the pixel's sum. */\n", p->name);
+    fprintf(fw, "    int s = c.r + c.g + c.b, best = 766, index = 0, k, d;\n");
+    fprintf(fw, "    for(k = %s_start[s] ; k < %i && %s_sums[k] - s <= best ; k++) {\n", p->name, p->colors, p->name);
+    fprintf(fw, "        d = abs(c.r - %s_key[%s_order[k]].r) + abs(c.g - %s_key[%s_order[k]].g) + abs(c.b - %s_key[%s_order[k]].b);\n", p->name, p->name, p->name, p->name, p->name, p->name);
+    fprintf(fw, "        if(d < best || (d == best && %s_order[k] < index)) { best = d; index = %s_order[k]; }\n", p->name, p->name);
+    fprintf(fw, "    }\n");
+    fprintf(fw, "    for(k = %s_start[s] - 1 ; k >= 0 && s - %s_sums[k] <= best ; k--) {\n", p->name, p->name);
+    fprintf(fw, "        d = abs(c.r - %s_key[%s_order[k]].r) + abs(c.g - %s_key[%s_order[k]].g) + abs(c.b - %s_key[%s_order[k]].b);\n", p->name, p->name, p->name, p->name, p->name, p->name);
+    fprintf(fw, "        if(d < best || (d == best && %s_order[k] < index)) { best = d; index = %s_order[k]; }\n", p->name, p->name);
+    fprintf(fw, "    }\n");
+    writeUnused(fw);
+    fprintf(fw, "    return index;\n}\n\n");
+}
+
+void writeLanes(FILE *fw, struct GenPalette *p, int first, int channel) { /* One vector of 8 colors, the last color is repeated to fill it. */
+    int i;
+    fprintf(fw, "_mm_setr_epi16(");
+    for(i = first ; i < first + 8 ; i++) {
+        int color = i < p->colors ? i:p->colors - 1;
+        fprintf(fw, "%s%i", i > first ? ", ":"", channel < 3 ? p->rgb[color][channel]:color);
+    }
+    fprintf(fw, ")");
+}
+
+void writeSimd(FILE *fw, struct GenPalette *p) {
+    int i, channel;
+
+    fprintf(fw, "int %s_match(struct RGBColor c, struct RGBColor *key, int n) { /* %i colors, 8 at a time. */\n", p->name, p->colors);
+    fprintf(fw, "#if defined(__SSE2__)\n");
+    fprintf(fw, "    __m128i r = _mm_set1_epi16(c.r), g = _mm_set1_epi16(c.g), b = _mm_set1_epi16(c.b), best;\n");
+    for(i = 0 ; i < p->colors ; i += 8) {
+        fprintf(fw, i == 0 ? "    best = keyScores(r, g, b":"    best = _mm_min_epi16(best, keyScores(r, g, b");
+        for(channel = 0 ; channel < 4 ; channel++) {
+            fprintf(fw, ",\n        ");
+            writeLanes(fw, p, i, channel);
+        }
+        fprintf(fw, i == 0 ? ");\n":"));\n");
+    }
+    writeUnused(fw);
+    fprintf(fw, "    return lowestScoreIndex(best);\n");
+    fprintf(fw, "#else\n");
+    writeUnrolled(fw, p);
+    fprintf(fw, "#endif\n}\n\n");
+}
+
+void writePalette(FILE *fw, struct GenPalette *p) {
+    int i, gray = 1;
+
+    fprintf(fw, "/* %s */\n", p->file);
+    fprintf(fw, "static char *%s_names[%i] = {", p->name, p->colors + 1);
+    for(i = 0 ; i < p->colors ; i++)
+        fprintf(fw, "\"%s\", ", p->blocks[i]);
+    fprintf(fw, "NULL};\n");
+    fprintf(fw, "static struct RGBColor %s_key[%i] = {", p->name, p->colors);
+    for(i = 0 ; i < p->colors ; i++)
+        fprintf(fw, "%s{%i, %i, %i, 0}", i ? ", ":"", p->rgb[i][0], p->rgb[i][1], p->rgb[i][2]);
+    fprintf(fw, "};\n");
+    fprintf(fw, "static uint32_t %s_pixelKey[%i] = {", p->name, p->colors);
+    for(i = 0 ; i < p->colors ; i++)
+        fprintf(fw, "%s0x%06X", i ? ", ":"", p->rgb[i][0] << 16 | p->rgb[i][1] << 8 | p->rgb[i][2]);
+    fprintf(fw, "};\n\n");
+
+    for(i = 0 ; i < p->colors ; i++)
+        if(chroma(p->rgb[i]) > GEN_GRAY_CHROMA)
+            gray = 0;
+
+    if(p->colors == 2)
+        writeTwoColors(fw, p);
+    else if(gray)
+        writeSorted(fw, p);
+    else if(p->colors <= GEN_SIMD_COLORS)
+        writeSimd(fw, p);
+    else {
+        fprintf(fw, "int %s_match(struct RGBColor c, struct RGBColor *key, int n) { /* %i colors. */\n", p->name, p->colors);
+        writeUnrolled(fw, p);
+        fprintf(fw, "}\n\n");
+    }
+}
+
+int main(int argc, char **argv) {
+    struct GenPalette *palettes;
+    FILE *fw;
+    int i, n = 0;
+
+    if(argc < 2) {
+        printf("Usage: genPalettes.exe <output file> <color key csv>...\n");
+        return 1;
+    }
+
+    palettes = malloc((argc - 2 > 0 ? argc - 2:1) * sizeof(struct GenPalette));
+    for(i = 2 ; i < argc ; i++) {
+        if(readPalette(argv[i], &palettes[n]))
+            n++;
+        else
+            printf("genPalettes could not read %s, it is left out.\n", argv[i]);
+    }
+
+    if((fw = fopen(argv[1], "w")) == NULL) {
+        printf("genPalettes could not write %s.\n", argv[1]);
+        free(palettes);
+        return 1;
+    }
+
+    fprintf(fw, "/*\nFile: %s\n\nNote: Generated by genPalettes.c from the bundled color keys when MIMM.bat runs. Edit the csv files, not this file.\n*/\n\n", argv[1]);
+    fprintf(fw, "#include <stdlib.h>\n#include \"palette.h\"\n\n");
+    fprintf(fw, "#if defined(__SSE2__)\n#include <emmintrin.h>\n\n");
+    fprintf(fw, "static __m128i absoluteDifference(__m128i a, __m128i b) {\n    return _mm_max_epi16(_mm_sub_epi16(a, b), _mm_sub_epi16(b, a));\n}\n\n");
+    fprintf(fw, "static __m128i keyScores(__m128i r, __m128i g, __m128i b, __m128i keyR, __m128i keyG, __m128i keyB, __m128i index) {\n");
+    fprintf(fw, "    /* (distance << 6 | index) fits in 16 bits unsigned. Taking 32768 away lets the signed minimum order them the same way. */\n");
+    fprintf(fw, "    __m128i d = _mm_add_epi16(_mm_add_epi16(absoluteDifference(r, keyR), absoluteDifference(g, keyG)), absoluteDifference(b, keyB));\n");
+    fprintf(fw, "    return _mm_add_epi16(_mm_or_si128(_mm_slli_epi16(d, 6), index), _mm_set1_epi16(-32768));\n}\n\n");
+    fprintf(fw, "static int lowestScoreIndex(__m128i best) {\n");
+    fprintf(fw, "    best = _mm_min_epi16(best, _mm_shuffle_epi32(best, 0x4E));\n");
+    fprintf(fw, "    best = _mm_min_epi16(best, _mm_shuffle_epi32(best, 0xB1));\n");
+    fprintf(fw, "    best = _mm_min_epi16(best, _mm_shufflelo_epi16(best, 0xB1));\n");
+    fprintf(fw, "    return _mm_extract_epi16(best, 0) & 63;\n}\n#endif\n\n");
+
+    for(i = 0 ; i < n ; i++)
+        writePalette(fw, &palettes[i]);
+
+    fprintf(fw, "struct BuiltinPalette builtinPalettes[%i] = {\n", n > 0 ? n:1);
+    for(i = 0 ; i < n ; i++)
+        fprintf(fw, "    {\"%s\", %i, %s_names, %s_key, %s_pixelKey, %s_match},\n", palettes[i].file, palettes[i].colors, palettes[i].name, palettes[i].name, palettes[i].name, palettes[i].name);
+    if(n == 0)
+        fprintf(fw, "    {\"\", 0, NULL, NULL, NULL, NULL}\n");
+    fprintf(fw, "};\nint builtinPaletteCount = %i;\n", n);
+
+    fclose(fw);
+    free(palettes);
+    return 0;
+}
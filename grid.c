@@ -0,0 +1,73 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: grid.c
+
+Note: The grid used to be 128 separately allocated rows of ints. Color keys never have more than a byte's worth of colors,
+so the grid is now one block of bytes with the rows one after another. Rows are padded to a multiple of 16 bytes.
+Filling and comparing work a whole row at a time with memset and memcmp.
+
+Timeline:
+20261019 - File created. Grid functions transfered over from commands.c and changed to the new grid.
+20261019 - gridsMatch and countMismatches ignore GRID_EMPTY pixels of the expected grid.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+
+struct Grid* allocGrid(int width, int height) {
+    struct Grid *grid = malloc(sizeof(struct Grid));
+    grid->width = width;
+    grid->height = height;
+    grid->stride = (width + 15) & ~15;
+    grid->cells = malloc(grid->stride * height);
+    clearGrid(grid);
+    return grid;
+}
+
+void freeGrid(struct Grid *grid) {
+    free(grid->cells);
+    free(grid);
+}
+
+void clearGrid(struct Grid *grid) {
+    memset(grid->cells, GRID_EMPTY, grid->stride * grid->height);
+}
+
+void fillGrid(struct Grid *grid, int startRow, int startCol, int endRow, int endCol, uint8_t color) {
+    int i;
+    for(i = startRow ; i <= endRow ; i++)
+        memset(&GRID(grid, i, startCol), color, endCol - startCol + 1);
+}
+
+void copyGrid(struct Grid *dest, struct Grid *src) { /* Both grids have to be the same size. */
+    memcpy(dest->cells, src->cells, src->stride * src->height);
+}
+
+int gridsMatch(struct Grid *expected, struct Grid *actual) { /* GRID_EMPTY pixels of the expected grid are masked out, so anything matches them. */
+    int i, j;
+    for(i = 0 ; i < expected->height ; i++) {
+        if(memcmp(&GRID(expected, i, 0), &GRID(actual, i, 0), expected->width) == 0)
+            continue;
+        for(j = 0 ; j < expected->width ; j++)
+            if(GRID(expected, i, j) != GRID_EMPTY && GRID(expected, i, j) != GRID(actual, i, j)) { /* Grids do not match */
+                printf("Mismatch at (%i, %i)\n", j, i);
+                return 0;
+            }
+    }
+    return 1;
+}
+
+int countMismatches(struct Grid *expected, struct Grid *actual) { /* Same as gridsMatch, GRID_EMPTY pixels of the expected grid never count. */
+    int i, j, count = 0;
+    for(i = 0 ; i < expected->height ; i++) {
+        uint8_t *row1 = &GRID(expected, i, 0), *row2 = &GRID(actual, i, 0);
+        if(memcmp(row1, row2, expected->width) == 0) /* Most rows match, so they are skipped as a whole. */
+            continue;
+        for(j = 0 ; j < expected->width ; j++)
+            count += row1[j] != GRID_EMPTY && row1[j] != row2[j];
+    }
+    return count;
+}
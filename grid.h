@@ -0,0 +1,35 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: grid.h
+
+Timeline:
+20261019 - File created.
+20261019 - The grid compared against is the expected grid, its GRID_EMPTY pixels are masked out.
+*/
+
+#ifndef GRID_H
+#define GRID_H
+
+#include <stdint.h>
+
+#define GRID_EMPTY 0xFF /* Takes the place of the -1 int grids used. No color key has this many colors. */
+#define GRID_MAX_COLORS 255
+#define GRID(g, row, col) ((g)->cells[(row) * (g)->stride + (col)])
+
+struct Grid { /* One contiguous block of color indices, one byte per pixel. */
+    int width;
+    int height;
+    int stride; /* Bytes from the start of one row to the start of the next. */
+    uint8_t *cells;
+};
+
+struct Grid* allocGrid(int width, int height);
+void freeGrid(struct Grid *grid);
+void clearGrid(struct Grid *grid);
+void fillGrid(struct Grid *grid, int startRow, int startCol, int endRow, int endCol, uint8_t color);
+void copyGrid(struct Grid *dest, struct Grid *src);
+int gridsMatch(struct Grid *expected, struct Grid *actual);
+int countMismatches(struct Grid *expected, struct Grid *actual);
+
+#endif
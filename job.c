@@ -0,0 +1,161 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: job.c
+
+Note: A job is one run of the pipeline that can be cancelled and tells whoever is listening how far along it is.
+beginJob makes a job the current job of the calling thread, and parallelFor hands it on to its worker threads, so the
+quantizer, the quad, the optimizer and the validator check it with jobCancelled() without it being passed down to them.
+A cancelled stage stops early and leaves its output incomplete but safe to free. Whoever runs the job checks jobCancelled()
+after every stage and throws the work away instead of writing it.
+Progress is reported as a stage and how much of it is done. It can come from any worker thread of a parallelFor, so the
+callback has to be safe to call from more than one thread at a time.
+
+A job runner is one thread that runs requests in the order they come, except that only the latest one matters.
+A request submitted while another waits replaces it, and one submitted while a job runs cancels that job. Work that has
+already gone stale never keeps a core busy.
+
+Timeline:
+20261019 - File created.
+20261019 - jobCancelled reads the flag with an interlocked operation now that worker threads check it too.
+*/
+
+#include <windows.h>
+#include <stdlib.h>
+#include "job.h"
+
+struct JobRunner {
+    CRITICAL_SECTION lock; /* Guards everything below except the thread. */
+    CONDITION_VARIABLE changed;
+    HANDLE thread;
+    void (*work)(void *request);
+    void *pending; /* The latest request that has not started, NULL when there is none. */
+    struct Job job; /* The job running now. */
+    int running;
+    int stopping;
+    long superseded; /* Requests thrown away or cancelled because a newer one came in. */
+};
+
+char *jobStageNames[JOB_STAGES] = {"Reading", "Quantizing", "Building the quad", "Optimizing", "Validating", "Writing"};
+
+__thread struct Job *threadJob = NULL;
+
+void initJob(struct Job *job, JobProgress progress, void *context) {
+    job->cancelled = 0;
+    job->progress = progress;
+    job->context = context;
+}
+
+void cancelJob(struct Job *job) {
+    InterlockedExchange((volatile LONG*)&job->cancelled, 1);
+}
+
+struct Job* beginJob(struct Job *job) { /* Returns the job it replaces, to be handed back to endJob. */
+    struct Job *previous = threadJob;
+    threadJob = job;
+    return previous;
+}
+
+void endJob(struct Job *previous) {
+    threadJob = previous;
+}
+
+struct Job* currentJob() {
+    return threadJob;
+}
+
+int jobCancelled() {
+    return threadJob != NULL && InterlockedCompareExchange((volatile LONG*)&threadJob->cancelled, 0, 0); /* Read with a barrier, it is set from other threads. */
+}
+
+void reportProgress(int stage, int done, int total) {
+    if(threadJob != NULL && threadJob->progress != NULL)
+        threadJob->progress(threadJob->context, stage, done, total);
+}
+
+DWORD WINAPI jobRunnerThread(LPVOID param) {
+    struct JobRunner *r = param;
+    struct Job *previous;
+    void *request;
+
+    while(1) {
+        EnterCriticalSection(&r->lock);
+        while(r->pending == NULL && !r->stopping)
+            SleepConditionVariableCS(&r->changed, &r->lock, INFINITE);
+        if(r->pending == NULL) { /* Stopping. */
+            LeaveCriticalSection(&r->lock);
+            return 0;
+        }
+        request = r->pending;
+        r->pending = NULL;
+        r->job.cancelled = 0;
+        r->running = 1;
+        LeaveCriticalSection(&r->lock);
+
+        previous = beginJob(&r->job);
+        r->work(request);
+        endJob(previous);
+        free(request);
+
+        EnterCriticalSection(&r->lock);
+        r->running = 0;
+        WakeAllConditionVariable(&r->changed);
+        LeaveCriticalSection(&r->lock);
+    }
+}
+
+struct JobRunner* allocJobRunner(void (*work)(void *request), JobProgress progress, void *context) {
+    struct JobRunner *r = calloc(1, sizeof(struct JobRunner));
+    r->work = work;
+    initJob(&r->job, progress, context);
+    InitializeCriticalSection(&r->lock);
+    InitializeConditionVariable(&r->changed);
+    r->thread = CreateThread(NULL, 0, jobRunnerThread, r, 0, NULL);
+    return r;
+}
+
+void submitJob(struct JobRunner *r, void *request) { /* Takes over 'request', which has to come from malloc. */
+    EnterCriticalSection(&r->lock);
+    if(r->pending != NULL) {
+        free(r->pending);
+        r->superseded++;
+    }
+    if(r->running && !r->job.cancelled) {
+        cancelJob(&r->job);
+        r->superseded++;
+    }
+    r->pending = request;
+    WakeAllConditionVariable(&r->changed);
+    LeaveCriticalSection(&r->lock);
+}
+
+void waitForJobs(struct JobRunner *r) { /* Returns once the latest request has run. */
+    EnterCriticalSection(&r->lock);
+    while(r->pending != NULL || r->running)
+        SleepConditionVariableCS(&r->changed, &r->lock, INFINITE);
+    LeaveCriticalSection(&r->lock);
+}
+
+long supersededJobs(struct JobRunner *r) {
+    long superseded;
+    EnterCriticalSection(&r->lock);
+    superseded = r->superseded;
+    LeaveCriticalSection(&r->lock);
+    return superseded;
+}
+
+void freeJobRunner(struct JobRunner *r) { /* Cancels whatever is running or waiting and stops the thread. */
+    EnterCriticalSection(&r->lock);
+    r->stopping = 1;
+    free(r->pending);
+    r->pending = NULL;
+    if(r->running)
+        cancelJob(&r->job);
+    WakeAllConditionVariable(&r->changed);
+    LeaveCriticalSection(&r->lock);
+
+    WaitForSingleObject(r->thread, INFINITE);
+    CloseHandle(r->thread);
+    DeleteCriticalSection(&r->lock);
+    free(r);
+}
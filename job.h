@@ -0,0 +1,47 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: job.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef JOB_H
+#define JOB_H
+
+#define JOB_READ 0
+#define JOB_QUANTIZE 1
+#define JOB_QUAD 2
+#define JOB_OPTIMIZE 3
+#define JOB_VALIDATE 4
+#define JOB_WRITE 5
+#define JOB_STAGES 6
+
+typedef void (*JobProgress)(void *context, int stage, int done, int total);
+
+struct Job {
+    volatile long cancelled;
+    JobProgress progress; /* NULL when nobody is listening. */
+    void *context;
+};
+
+struct JobRunner;
+
+extern char *jobStageNames[JOB_STAGES];
+
+void initJob(struct Job *job, JobProgress progress, void *context);
+void cancelJob(struct Job *job);
+struct Job* beginJob(struct Job *job);
+void endJob(struct Job *previous);
+struct Job* currentJob();
+int jobCancelled();
+void reportProgress(int stage, int done, int total);
+
+struct JobRunner* allocJobRunner(void (*work)(void *request), JobProgress progress, void *context);
+void submitJob(struct JobRunner *r, void *request);
+void waitForJobs(struct JobRunner *r);
+long supersededJobs(struct JobRunner *r);
+void freeJobRunner(struct JobRunner *r);
+
+#endif
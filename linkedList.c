@@ -6,6 +6,7 @@ File: linkedList.c
 Timeline:
 20240808 - File created.
 20241113 - Fixed clone marker function.
+20261019 - Added clone markers for the /clone command. cloneMarker copies the clone fields too.
 */
 
 #include "linkedList.h"
@@ -21,11 +22,26 @@ struct Marker* allocMarker(int startCol, int startRow, int endCol, int endRow, i
     m->high = endCol;
     m->colorKey = colorKey;
     m->neuter = 0;
+    m->clone = 0;
+    m->destCol = 0;
+    m->destRow = 0;
+    return m;
+}
+
+struct Marker* allocCloneMarker(int startCol, int startRow, int endCol, int endRow, int destCol, int destRow) {
+    struct Marker *m = allocMarker(startCol, startRow, endCol, endRow, 0);
+    m->clone = 1;
+    m->destCol = destCol;
+    m->destRow = destRow;
     return m;
 }
 
 struct Marker* cloneMarker(struct Marker *m) {
-    return allocMarker(m->startCol, m->startRow, m->endCol, m->endRow, m->colorKey);
+    struct Marker *copy = allocMarker(m->startCol, m->startRow, m->endCol, m->endRow, m->colorKey);
+    copy->clone = m->clone;
+    copy->destCol = m->destCol;
+    copy->destRow = m->destRow;
+    return copy;
 }
 
 struct Node* allocNode(struct Marker *m) {
@@ -6,8 +6,13 @@ File: linkedList.h
 Timeline:
 20240810 - File created.
 20240817 - Added marker.
+20261019 - Added include guard since the header is now included by more than one file.
+20261019 - Markers can be clones, which copy their area to another spot instead of filling it.
 */
 
+#ifndef LINKEDLIST_H
+#define LINKEDLIST_H
+
 #include <stdlib.h>
 
 struct Marker {
@@ -19,6 +24,9 @@ struct Marker {
     int high;
     int colorKey; /* A number used as a key to identify the color of the node. */
     int neuter; /* Used to determine if the marker should create a new command or be ignored. */
+    int clone; /* When set, the marker copies its area to (destCol, destRow) instead of filling it with a color. */
+    int destCol;
+    int destRow;
 };
 
 struct Node { /* The node helps keep track of important information to write commands. */
@@ -33,10 +41,13 @@ struct LinkedList {
 
 struct Marker* allocMarker(int startCol, int startRow, int endCol, int endRow, int colorKey);
 struct Marker* cloneMarker(struct Marker*);
+struct Marker* allocCloneMarker(int startCol, int startRow, int endCol, int endRow, int destCol, int destRow);
 int LL_empty(struct LinkedList *ll);
 void LL_append(struct LinkedList *ll, struct Marker *m);
 void LL_insert(struct LinkedList *ll, struct Node *prev, struct Marker *m);
 struct Marker* LL_removeHead(struct LinkedList *ll);
 struct Marker* LL_remove(struct LinkedList *ll, struct Node *prev, struct Node **remove);
 void LL_print(struct LinkedList *ll);
-void printMarker(struct Marker *m); 
\ No newline at end of file
+void printMarker(struct Marker *m); 
+
+#endif
\ No newline at end of file
@@ -28,6 +28,33 @@ New set up does not cause a crash when interacting with the window, as commands
 New combo box added for level of detail.
 20241209 - Begining to make UI components and window scalable.
 20250218 - Made the window's UI components scale when resized.
+20261019 - Moved grid and optimization functions to commands.c. Added an 'auto' level of detail that runs the auto tuner.
+20261019 - The quad is now built with buildQuadExact so coarse levels of detail use the true majority color.
+20261019 - Moved color key functions to palette.c. Added command line modes, starting with -delta.
+20261019 - Added the -sequence command line mode.
+20261019 - Added the -search command line mode.
+20261019 - Grids are now the contiguous byte grid from grid.c.
+20261019 - Added the -clone command line mode. Clone commands are simulated and skipped by the checks in testCommands.
+20261019 - Added the -requantize command line mode.
+20261019 - Added the -daemon and -request command line modes.
+20261019 - testCommands does not flag masked (GRID_EMPTY) pixels.
+20261019 - generateCommands writes the commands chunk by chunk. Added the -chunks command line mode.
+20261019 - Added the 'adaptive' level of detail and the -adaptive command line mode.
+20261019 - Added the -progressive command line mode.
+20261019 - Added the -reduce command line mode.
+20261019 - readImage loads the color key with loadColorKey, so built in palettes are not read from their csv.
+20261019 - Added the -convert command line mode and a plan cache directory for -daemon.
+20261019 - imageChange hands the image to a job runner thread instead of running it inside the message loop. A newer change
+cancels the run that is already going, and Begin waits for the latest run to finish writing its commands.
+20261019 - Added the -mapitem command line mode.
+20261019 - Added the -edit command line mode.
+20261019 - readImage matches the image as it reads it with decodeQuantize.
+20261019 - Added the -tolerance command line mode.
+20261019 - Added the -components command line mode.
+20261019 - The usage mentions builtin: color keys.
+20261019 - The auto tuner is asked to print the levels it tried.
+20261019 - readImage stops on an image or color key it can not read instead of planning garbage.
+20261019 - testCommands only pauses on a wrong pixel when it is not running as a job.
 */
 
 #include <windows.h>
@@ -38,11 +65,40 @@ New combo box added for level of detail.
 #include "bmp.h"
 #include "linkedList.h"
 #include "quad.h"
+#include "commands.h"
+#include "tune.h"
+#include "palette.h"
+#include "delta.h"
+#include "sequence.h"
+#include "search.h"
+#include "clone.h"
+#include "requantize.h"
+#include "daemon.h"
+#include "chunks.h"
+#include "progressive.h"
+#include "reduce.h"
+#include "cache.h"
+#include "job.h"
+#include "mapitem.h"
+#include "session.h"
+#include "tolerance.h"
+#include "components.h"
 #include "windowUtil.h"
 #include "display.h"
 
 #define LINE_LIMIT 128
 
+struct ImageRequest { /* What imageChange hands to the job runner. */
+    HDC hdc;
+    int scale;
+    int detail;
+    char image[128];
+    char key[128];
+};
+
+struct JobRunner *imageJobs = NULL;
+volatile LONG lastStage = -1; /* The stage printed last, so every stage is only printed once. */
+
 uint32_t* allocScaledPixels(uint32_t *pixels, int width, int height, int scale) {
     uint32_t *scaled = malloc(width * scale * height * scale * sizeof(uint32_t));
     int i, j, k, ip = 0, is = 0;
@@ -108,6 +164,11 @@ void simulateCommand(HDC hdc, struct Marker *m, uint32_t color, int xOffset, int
     free(pixels);
 }
 
+void simulateClone(HDC hdc, struct Marker *m, int xOffset, int yOffset, int scale) {
+    BitBlt(hdc, (m->destCol + xOffset) * scale, (m->destRow + yOffset) * scale, (m->endCol - m->startCol + 1) * scale, (m->endRow - m->startRow + 1) * scale,
+        hdc, (m->startCol + xOffset) * scale, (m->startRow + yOffset) * scale, SRCCOPY);
+}
+
 void clearDisplay(HDC hdc, int scale) {
     uint32_t *pixels = allocSolidColor(128, 128, 0x0FF00FF);
     fillRectangle(hdc, pixels, 128, 0, 256, 128, scale);
@@ -123,9 +184,13 @@ int progressCommands(HDC hdc, HWND selectedWindow, FILE *commands, FILE *colors,
         return 0;
 
     fscanf(colors, "%u", &color);
-    sscanf(command, "/fill ~%i ~-1 ~%i ~%i ~-1 ~%i", &m.startCol, &m.startRow, &m.endCol, &m.endRow);
     inputCommand(selectedWindow, command);
-    simulateCommand(hdc, &m, color, 128, 0, scale);
+    if(sscanf(command, "/clone ~%i ~-1 ~%i ~%i ~-1 ~%i ~%i ~-1 ~%i", &m.startCol, &m.startRow, &m.endCol, &m.endRow, &m.destCol, &m.destRow) == 6)
+        simulateClone(hdc, &m, 128, 0, scale);
+    else {
+        sscanf(command, "/fill ~%i ~-1 ~%i ~%i ~-1 ~%i", &m.startCol, &m.startRow, &m.endCol, &m.endRow);
+        simulateCommand(hdc, &m, color, 128, 0, scale);
+    }
 
     return 1;
 }
@@ -139,83 +204,6 @@ HWND selectWindow() {
     return selectedWindow;
 }
 
-void imprintGrid(struct LinkedList *queue, int **grid) {
-    int i, j;
-    struct Node *n = queue->head;
-
-    /* Since not all the indices may be filled, filling them with a default. */
-    for(i = 0 ; i < 128 ; i++) {
-        for(j = 0 ; j < 128 ; j++)
-            grid[i][j] = -1; /* Setting to negative 1 since that is an impossible index. */
-    }
-    
-    while(n != NULL) {
-        for(i = n->marker->startRow ; i <= n->marker->endRow ; i++) {
-            for(j = n->marker->startCol ; j <= n->marker->endCol ; j++) {
-                grid[i][j] = n->marker->colorKey;
-            }
-        }
-        n = n->next;
-    }
-}
-
-int **allocGrid() {
-    int i, j, **grid = malloc(128 * sizeof(int*));
-    for(i = 0 ; i < 128 ; i++) {
-        grid[i] = malloc(128 * sizeof(int));
-        for(j = 0 ; j < 128 ; j++)
-            grid[i][j] = -1; /* Setting to negative 1 since that is an impossible index. */
-    }
-    return grid;
-}
-
-void freeGrid(int **grid) {
-    int i;
-    for(i = 0 ; i < 128 ; i++)
-        free(grid[i]);
-    free(grid); 
-}
-
-int gridsMatch(int **grid1, int **grid2) {
-    int i, j;
-    for(i = 0 ; i < 128 ; i++)
-        for(j = 0 ; j < 128 ; j++)  
-            if(grid1[i][j] != grid2[i][j]) { /* Grids do not match */
-                printf("Mismatch at (%i, %i)\n", j, i);
-                return 0;
-            }
-    return 1;
-}
-
-int getDiff(struct RGBColor c1, struct RGBColor c2) {
-    return (c1.r > c2.r ? (c1.r - c2.r):(c2.r - c1.r)) + (c1.g > c2.g ? (c1.g - c2.g):(c2.g - c1.g)) + (c1.b > c2.b ? (c1.b - c2.b):(c2.b - c1.b));
-}
-
-int selectColorIndex(struct RGBColor compare, FILE *colorKey) {
-    char block[128], blockBuffer[128];
-    int line = 0, index = 0, diff, diffBuffer, r, g, b;
-    struct RGBColor rgb, rgbBuffer;
-
-    rewind(colorKey);
-    fscanf(colorKey, "%i,%i,%i,%s", &rgb.r, &rgb.g, &rgb.b, block);
-    diff = getDiff(compare, rgb);
-    while(fscanf(colorKey, "%i,%i,%i,%s", &r, &g, &b, blockBuffer) != EOF) { /* I use buffer values for the buffer itself since somehow rgb kept getting zeroed out when rgbBuffer was used directly. */
-        line++;
-        rgbBuffer.r = r;
-        rgbBuffer.g = g;
-        rgbBuffer.b = b;
-        diffBuffer = getDiff(compare, rgbBuffer);
-        if(diffBuffer < diff) {
-            rgb = rgbBuffer;
-            strcpy(block, blockBuffer);
-            diff = diffBuffer;
-            index = line;
-        }
-    }
-
-    return index;
-}
-
 COLORREF rgbFromIndex(int index, FILE *colorKey) {
     int i, r, g, b;
     char buffer[128];
@@ -230,201 +218,26 @@ COLORREF rgbFromIndex(int index, FILE *colorKey) {
     return RGB(r, g, b);
 }
 
-void writeCommand(FILE *commands, struct Marker *marker, char **colors) {
-    fprintf(commands, "/fill ~%i ~-1 ~%i ~%i ~-1 ~%i minecraft:%s\n", marker->startCol, marker->startRow, marker->endCol, marker->endRow, colors[marker->colorKey]);
-}
-
-struct Marker* allocQuadMarker(struct Quad *q) {
-    return allocMarker(q->col, q->row, q->col + q->size - 1, q->row + q->size - 1, q->color);
-}
-
-void quad(struct Quad *q, struct LinkedList *queue, int *layers, int limit, int layer) {
-    int i;
-    if(q->size <= limit || q->leaf) {
-        LL_append(queue, allocQuadMarker(q));
-        return;
-    }
-
-    for(i = 0 ; i < 4 ; i++)
-        quad(q->children[i], queue, layers, limit, layer + 1);
-}
-
-void prioritizeMarkers(struct LinkedList *pq, int *counters, int n) {
-    int i;
-    for(i = 0 ; i < n ; i++) {
-        if(counters[i] == 0)
-            continue;
-        if(LL_empty(pq) || counters[pq->tail->marker->colorKey] >= counters[i])
-            LL_append(pq, allocMarker(0, 0, 0, 0, i));
-        else {
-            struct Node *prev = NULL, *n = pq->head;
-            while(counters[n->marker->colorKey] >= counters[i]) {
-                prev = n;
-                n = n->next;
-            }
-            LL_insert(pq, prev, allocMarker(0, 0, 0, 0, i));
-        }
-    }
-}
-
-void extractColor(struct LinkedList (*lines)[128], int c) { /* Merges markers of color c in a single row together horizontally. */
-    int i;
-    for(i = 0 ; i < 128 ; i++) {
-        int low = 0;
-        struct Node *prev = NULL, *n = lines[0][i].head;
-        while(n != NULL) {
-            struct Marker *m1 = cloneMarker(n->marker); /* Starting by copy a valid marker. Any existing marker is of equal or lower priority */
-            LL_append(&lines[1][i], m1); /* Adding the marker to the separate line set exclusive to the color 'c' */
-            if(n->marker->colorKey == c) /* Taking the place of the marker with the same color. */
-                free(LL_remove(&lines[0][i], prev, &n));
-            else { /* Setting the marker up to be a filler marker in case no 'real' marker is found. */
-                m1->colorKey = c; /* Setting the filler markers color key to the current color being extracted. */
-                m1->neuter = 1; /* This is set in case no instance of the color is encountered on this row. */
-                prev = n;
-                n = n->next;
-            }
-            while(n != NULL) {
-                struct Marker *m2 = n->marker;
-                if(m1->high + 1 == m2->startCol) {
-                    m1->high = m2->endCol;
-                    if(m2->colorKey == c) {
-                        if(m1->neuter) {
-                            m1->neuter = 0; /* Turn the filler marker into a 'real' marker. */
-                            m1->startCol = m2->startCol; /* Setting the 'startCol' (we want to keep 'low') */
-                        }
-                        m1->endCol = m2->endCol;
-                        free(LL_remove(&lines[0][i], prev, &n));
-                    }
-                    else {
-                        prev = n;
-                        n = n->next;
-                    }
-                }
-                else
-                    break;
-            }
-        }
-    }
-}
-
-int mergeMarker(struct Marker *m1, struct Marker *m2) {
-    if(m1->startCol < m2->low || m1->endCol > m2->high || m2->startCol < m1->low || m2->endCol > m1->high) /* The markers cannot fit into eachother. */
-        return 0;
-
-    m2->startRow = m1->startRow; /* The startRow will always be taken from m1. */
-    m2->neuter = m1->neuter; /* This should always be 0 if a merge occurs, but I am doing this just in case. */
-   
-    m2->startCol = m1->startCol < m2->startCol ? m1->startCol:m2->startCol;
-    m2->endCol = m1->endCol > m2->endCol ? m1->endCol:m2->endCol;
-    m2->low = m1->low > m2->low ? m1->low:m2->low;
-    m2->high = m1->high < m2->high ? m1->high:m2->high;
-
-    return 1;
-}
-
-void mergeColor(struct LinkedList *q, struct LinkedList *lines /* This is just the 'single color' set of lines. */, int detail) {
-    int i;
-
-    for(i = 0 ; i < 127 ; i++) {
-        struct Node *prev = NULL, *n1 = lines[i].head, *n2 = lines[i + detail].head;
-        while(n1 != NULL && n2 != NULL) {
-            if(n1->marker->neuter) {
-                prev = n1;
-                n1 = n1->next;
-                continue;
-            }
-
-            while(n2 != NULL && n2->marker->high < n1->marker->startCol)
-                n2 = n2->next;
-
-            if(n2 == NULL)
-                break;
-
-            if(mergeMarker(n1->marker, n2->marker))
-                free(LL_remove(&lines[i], prev, &n1));
-            else {
-                prev = n1;
-                n1 = n1->next;
-            }
-        }
-    }
-
-    for(i = 0 ; i < 128 ; i++) {
-        while(!LL_empty(&lines[i]))
-            if(lines[i].head->marker->neuter)
-                free(LL_removeHead(&lines[i]));
-            else
-                LL_append(q, LL_removeHead(&lines[i]));
-    }
-}
-
-void mergeCommands(struct LinkedList (*lines)[128], struct LinkedList *q, int colors, int detail) {
-    int i, lastColor = -1;
-    int *counters = malloc(colors * sizeof(int));
-    struct LinkedList priorityQueue = {NULL, NULL};
-
-    for(i = 0 ; i < colors ; i++)
-        counters[i] = 0;
-
-    while(!LL_empty(q)) {
-        struct Marker *m = LL_removeHead(q);
-        LL_append(&lines[0][m->startRow], m);
-        LL_append(&lines[1][m->startCol], m);
-    }
-
-    for(i = 0 ; i < 128 ; i++) {
-        int lastColor = -1;
-        struct Node *n = lines[0][i].head;
-        while(n != NULL) {
-            if(lastColor != n->marker->colorKey) {
-                counters[n->marker->colorKey]++;
-                lastColor = n->marker->colorKey;
-            }
-            n = n->next;
-        }
-        lastColor = -1;
-        while(!LL_empty(&lines[1][i])) {
-            if(lastColor != lines[1][i].head->marker->colorKey) {
-                counters[lines[1][i].head->marker->colorKey]++;
-                lastColor = lines[1][i].head->marker->colorKey;
-            }
-            LL_removeHead(&lines[1][i]);
-        }
-    }
-
-    prioritizeMarkers(&priorityQueue, counters, colors);
-
-    while(!LL_empty(&priorityQueue)) {
-        int c = priorityQueue.head->marker->colorKey;
-        free(LL_removeHead(&priorityQueue));
-        extractColor(lines, c);
-        mergeColor(q, lines[1], detail);
-    }
-}
-
-void optimizeCommands(struct LinkedList *queue, int colors, int detail) {
-    int i;
-    struct LinkedList priorityQueue = {NULL, NULL}, lines[2][128];
-    for(i = 0 ; i < 128 ; i++) {
-        lines[0][i].head = NULL;
-        lines[0][i].tail = NULL;
-        lines[1][i].head = NULL;
-        lines[1][i].tail = NULL;
-    }
-
-    mergeCommands(lines, queue, colors, detail);
-}
 
-void testCommands(HDC hdc, uint32_t *pixelKey, int **original, int **optimized, int scale, struct LinkedList *q) {
-    int i, j, count = 1;
+void testCommands(HDC hdc, uint32_t *pixelKey, struct Grid *original, struct Grid *optimized, int scale, struct LinkedList *q) {
+    int i, j, count = 1, total = queueLength(q);
     struct Node *n = q->head;
-    while(n != NULL) {
+    while(n != NULL && !jobCancelled()) {
         int wrong = 0, p = 0;
         struct Marker *m = n->marker;
-        uint32_t *pixels = allocSolidColor(m->endCol - m->startCol + 1, m->endRow - m->startRow + 1, 0x0000FFFF);
+        uint32_t *pixels;
+        if(count % 64 == 1)
+            reportProgress(JOB_VALIDATE, count - 1, total);
+        if(m->clone) { /* Clones come after every fill, the copy is checked by the grids matching. */
+            simulateClone(hdc, m, 128, 0, scale);
+            n = n->next;
+            count++;
+            continue;
+        }
+        pixels = allocSolidColor(m->endCol - m->startCol + 1, m->endRow - m->startRow + 1, 0x0000FFFF);
         for(i = m->endRow ; i >= m->startRow ; i--)
             for(j = m->startCol ; j <= m->endCol ; j++) {
-                if(original[i][j] != optimized[i][j] && optimized[i][j] == m->colorKey) {
+                if(GRID(original, i, j) != GRID_EMPTY && GRID(original, i, j) != GRID(optimized, i, j) && GRID(optimized, i, j) == m->colorKey) {
                     wrong = 1;
                     pixels[p] = 0x00FF00FF; /* Marking incorrect pixels as magenta. */
                 }
@@ -434,7 +247,8 @@ void testCommands(HDC hdc, uint32_t *pixelKey, int **original, int **optimized,
         if(wrong) {
             fillRectangle(hdc, pixels, m->startCol + 128, m->startRow, m->endCol + 1 + 128, m->endRow + 1, scale); /* Fill the rectangle back in to hide outline. */    
             printf("ERROR: %i, Start: (%i, %i), Color: %i\n", count, m->startCol, m->startRow, m->colorKey);
-            getc(stdin); /* Pause for viewing */
+            if(currentJob() == NULL) /* Pause for viewing, but never on the job runner, a newer image could not cancel the wait. */
+                getc(stdin);
         }
         free(pixels);
 
@@ -447,10 +261,11 @@ void testCommands(HDC hdc, uint32_t *pixelKey, int **original, int **optimized,
     }
 }
 
-void generateCommands(struct Quad q, char **colors, uint32_t *pixelKey, int detail, int scale, HDC hdc) {
-    FILE *commands = fopen(".\\commands.txt", "w"), *pixelColors = fopen(".\\pixelColors.txt", "w");
-    struct LinkedList commandQueue = {NULL, NULL};
-    int i, n = 0, *layers, **originalGrid = allocGrid(), **optimizedGrid = allocGrid();
+void generateCommands(struct Quad q, struct Grid *grid, char **colors, uint32_t *pixelKey, int detail, int scale, HDC hdc) {
+    struct LinkedList commandQueue = {NULL, NULL}, quadQueue = {NULL, NULL};
+    struct ChunkReport report;
+    int i = 0, n = 0, *layers;
+    struct Grid *originalGrid = allocGrid(128, 128), *optimizedGrid = allocGrid(128, 128);
 
     while(colors[i++] != NULL);
     n = i - 1;
@@ -460,98 +275,86 @@ void generateCommands(struct Quad q, char **colors, uint32_t *pixelKey, int deta
     for(i = 0 ; i < n ; i++)
         layers[i] = __INT_MAX__;
 
-    quad(&q, &commandQueue, layers, detail, 0);
-    imprintGrid(&commandQueue, originalGrid);
-    optimizeCommands(&commandQueue, n, detail);
-    imprintGrid(&commandQueue, optimizedGrid);
-    testCommands(hdc, pixelKey, originalGrid, optimizedGrid, scale, &commandQueue);
+    if(detail < 0) { /* Adaptive, the quad is cut by error instead of at one level of detail. */
+        detail = adaptiveCommands(&q, grid, n, TUNE_ERROR_BUDGET, 0, &commandQueue);
+        adaptiveQuad(&q, &quadQueue, TUNE_ERROR_BUDGET, detail);
+    }
+    else {
+        if(detail == 0) /* No level of detail given, so the auto tuner picks one and hands back its optimized commands. */
+            detail = autoTune(&q, grid, n, TUNE_ERROR_BUDGET, 1, &commandQueue);
+        else {
+            quad(&q, &commandQueue, layers, detail, 0);
+            optimizeCommands(&commandQueue, n, detail);
+        }
+        quad(&q, &quadQueue, layers, detail, 0);
+    }
+    imprintGrid(&quadQueue, originalGrid);
+    freeQueue(&quadQueue);
+    if(!jobCancelled()) {
+        chunkOrder(&commandQueue, 128, 128, CHUNK_HILBERT, 0, &report);
+        printChunkReport(&report);
+        imprintGrid(&commandQueue, optimizedGrid);
+        testCommands(hdc, pixelKey, originalGrid, optimizedGrid, scale, &commandQueue);
+    }
 
-    while(!LL_empty(&commandQueue)) {
-        fprintf(pixelColors, "%u\n", pixelKey[commandQueue.head->marker->colorKey]);
-        writeCommand(commands, commandQueue.head->marker, colors);
-        free(LL_removeHead(&commandQueue));
+    if(jobCancelled()) /* A newer image change is waiting, so these commands are stale. */
+        freeQueue(&commandQueue);
+    else {
+        reportProgress(JOB_WRITE, 0, 1);
+        writeCommands(&commandQueue, colors, pixelKey);
+        reportProgress(JOB_WRITE, 1, 1);
     }
-    fclose(commands);
-    fclose(pixelColors);
     freeGrid(originalGrid);
     freeGrid(optimizedGrid);
     free(layers);
 }
 
-int amountOfColors(FILE *colorKey) {
-    int i = 0, i1, i2, i3, n = 0;
-    char s[128];
-
-    rewind(colorKey);
-    while(fscanf(colorKey, "%i,%i,%i,%s", &i1, &i2, &i3, s) != EOF) /* Figuring out how many colors should be in the key. */
-        n++;
-    return n;
-}
-
-char** getColorNames(FILE *colorKey, int n) {
-    int i = 0, i1, i2, i3;
-    char **colors;
-    
-    colors = malloc((n + 1) * sizeof(char*));
-    rewind(colorKey);
-    for(i = 0 ; i < n ; i++) {
-        colors[i] = malloc(128 * sizeof(char));
-        fscanf(colorKey, "%i,%i,%i,%s", &i1, &i2, &i3, colors[i]);
-    }
-    colors[n] = NULL;
-    return colors;
-}
-
-uint32_t* getPixelKey(FILE *colorKey, int n) {
-    int i = 0;
-    char buffer[64];
-    struct RGBColor rgb;
-    uint32_t *pixels = malloc(n * sizeof(uint32_t));
-    
-    rewind(colorKey);
-    for(i = 0 ; i < n ; i++) {
-        fscanf(colorKey, "%i,%i,%i,%s", &rgb.r, &rgb.g, &rgb.b, buffer);
-        pixels[i] = rgbToPixel(rgb);
-    }
-
-    return pixels;
-}
-
 void readImage(HDC hdc, int scale, int detail, char *image, char *key) {
     FILE *fr = fopen(image, "rb");
-    FILE *colorKey = fopen(key, "r");
-    int **grid = allocGrid();
-    int transparency = 0, i, j, p = 0, n = amountOfColors(colorKey);
-    struct BMPHeader h = readBMPHeader(fr);
-    struct RGBColor rgb, minecraftRGB, *minecraftRGBs;
+    struct Grid *grid;
     struct Quad q;
-    char **colors = getColorNames(colorKey, n);
-    uint32_t *pixels = malloc(128 * 128 * sizeof(uint32_t)), *pixelKey = getPixelKey(colorKey, n), pixel = 0;
-
-    if(h.bitsPerPixel > 24)
-        transparency = 1;
-
-    for(i = 0 ; i < 128 * 128 ; i++) 
-        pixels[i] = readPixel(fr, transparency);
-
-    fillRectangle(hdc, pixels, 0, 0, 128, 128, scale);
-
-    for(i = 0 ; i < 128 ; i++) {
-        for(j = 0 ; j < 128 ; j++)
-            grid[i][j] = selectColorIndex(pixelToRGB(pixels[(127 - i) * 128 + j]), colorKey);
+    struct RGBColor *keyColors;
+    char **colors;
+    struct BMPHeader h;
+    uint32_t *pixels, *pixelKey; /* pixels is only kept for the picture in the window. */
+    int n;
+
+    if(fr == NULL || (n = loadColorKey(key, &colors, &keyColors, &pixelKey)) <= 0) {
+        printf("Could not open %s or the color key %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        return;
+    }
+    grid = allocGrid(128, 128);
+    pixels = malloc(128 * 128 * sizeof(uint32_t));
+    h = readBMPHeader(fr);
+
+    reportProgress(JOB_READ, 0, 1);
+    if(!decodeQuantize(fr, &h, keyColors, n, grid, pixels))
+        printf("Could not read %s, it needs to be a 24 or 32 bit bmp.\n", image);
+    else if(!jobCancelled()) {
+        fillRectangle(hdc, pixels, 0, 0, 128, 128, scale);
+        q = buildQuadExact(grid, n, 128);
+        if(!jobCancelled())
+            generateCommands(q, grid, colors, pixelKey, detail, scale, hdc);
+        destroyQuad(&q);
     }
-
-    q = buildQuadOG(grid, 128);
-    generateCommands(q, colors, pixelKey, detail, scale, hdc);
-    destroyQuad(&q);
     freeGrid(grid);
-    for(i = 0 ; colors[i] != NULL ; i++)
-        free(colors[i]);
-    free(colors);
+    freeColorNames(colors);
+    free(keyColors);
     free(pixels);
     free(pixelKey);
     fclose(fr);
-    fclose(colorKey);
+}
+
+void runImageRequest(void *request) { /* Runs on the job runner's thread. */
+    struct ImageRequest *r = request;
+    readImage(r->hdc, r->scale, r->detail, r->image, r->key);
+}
+
+void printStage(void *context, int stage, int done, int total) {
+    if(InterlockedExchange(&lastStage, stage) != stage)
+        printf("%s...\n", jobStageNames[stage]);
 }
 
 void fillComboBox(HWND comboBox, char *fileName) {
@@ -578,8 +381,9 @@ void getComboBoxText(HWND combo, char *dest) {
     sprintf(dest, "%ls", buffer);
 }
 
-void imageChange(HWND parent) {
-    char image[128] = "images\\", colorKey[128] = "colorKeys\\", detailBuffer[4];
+void imageChange(HWND parent) { /* Queues the selected image to be read, any run still going for an older selection is cancelled. */
+    char image[128] = "images\\", colorKey[128] = "colorKeys\\", detailBuffer[16];
+    struct ImageRequest *request = malloc(sizeof(struct ImageRequest));
     int detail = 0;
     HWND comboHolder = FindWindowExW(parent, NULL, NULL, NULL), combo = FindWindowExW(comboHolder, NULL, NULL, NULL), display = FindWindowExW(parent, comboHolder, NULL, NULL);
     getComboBoxText(combo, image + strlen(image));
@@ -587,8 +391,78 @@ void imageChange(HWND parent) {
     getComboBoxText(combo, colorKey + strlen(colorKey));
     combo = FindWindowExW(comboHolder, combo, NULL, NULL);
     getComboBoxText(combo, detailBuffer);
-    sscanf(detailBuffer, "%i", &detail);
-    readImage(getDisplayDC(display), getDisplayScale(display), detail, image, colorKey);
+    sscanf(detailBuffer, "%i", &detail); /* The 'auto' entry leaves detail at 0. */
+    if(strcmp(detailBuffer, "adaptive") == 0)
+        detail = -1;
+    request->hdc = getDisplayDC(display);
+    request->scale = getDisplayScale(display);
+    request->detail = detail;
+    strcpy(request->image, image);
+    strcpy(request->key, colorKey);
+    submitJob(imageJobs, request);
+}
+
+int runCommandLine(char *cmd) { /* Returns 1 if the command line asked for a mode that runs without the window. */
+    char mode[32], a[128], b[128] = "", c[128] = "";
+    int first, count, detail = 1, budget = SEARCH_DEFAULT_BUDGET, minSize = CLONE_MIN_SIZE, workers = 0, queueLimit = 0, offset = 0, split = 0, errorBudget = TUNE_ERROR_BUDGET, blocks = 0, cacheSize = CACHE_DEFAULT_MB, mapId = 0, tolerance = TOLERANCE_DEFAULT;
+    long nearBudget = TOLERANCE_ERROR_BUDGET;
+
+    if(cmd == NULL || sscanf(cmd, "%31s", mode) != 1)
+        return 0;
+
+    if(strcmp(mode, "-delta") == 0 && sscanf(cmd, "%*s %127s %127s %127s", a, b, c) == 3)
+        deltaMode(a, b, c);
+    else if(strcmp(mode, "-sequence") == 0 && sscanf(cmd, "%*s %127s %i %i %127s %i %31s", a, &first, &count, b, &detail, c) >= 4)
+        sequenceMode(a, first, count, b, detail, strstr(cmd, " delta") != NULL);
+    else if(strcmp(mode, "-search") == 0 && sscanf(cmd, "%*s %127s %127s %i %i", a, b, &detail, &budget) >= 3)
+        searchMode(a, b, detail, budget);
+    else if(strcmp(mode, "-clone") == 0 && sscanf(cmd, "%*s %127s %127s %i %i", a, b, &detail, &minSize) >= 3)
+        cloneMode(a, b, detail, minSize);
+    else if(strcmp(mode, "-requantize") == 0 && sscanf(cmd, "%*s %127s %127s %127s %i", a, b, c, &detail) >= 3)
+        requantizeMode(a, b, c, detail);
+    else if(strcmp(mode, "-adaptive") == 0 && sscanf(cmd, "%*s %127s %127s %i", a, b, &errorBudget) >= 2)
+        adaptiveMode(a, b, errorBudget, strstr(cmd, " node") != NULL);
+    else if(strcmp(mode, "-progressive") == 0 && sscanf(cmd, "%*s %127s %127s %i", a, b, &detail) >= 2)
+        progressiveMode(a, b, detail);
+    else if(strcmp(mode, "-reduce") == 0 && sscanf(cmd, "%*s %127s %127s %i %i", a, b, &detail, &blocks) >= 2)
+        reduceMode(a, b, detail, blocks);
+    else if(strcmp(mode, "-convert") == 0 && sscanf(cmd, "%*s %127s %127s %i %127s %i", a, b, &detail, c, &cacheSize) >= 2)
+        convertMode(a, b, detail, c, cacheSize);
+    else if(strcmp(mode, "-mapitem") == 0 && sscanf(cmd, "%*s %127s %i %127s %127s", a, &mapId, c, b) >= 1)
+        mapItemMode(a, mapId, c, b);
+    else if(strcmp(mode, "-edit") == 0 && sscanf(cmd, "%*s %127s %127s %i %127s %i", a, b, &detail, c, &mapId) >= 4)
+        editMode(a, b, detail, c, mapId);
+    else if(strcmp(mode, "-tolerance") == 0 && sscanf(cmd, "%*s %127s %127s %i %i %li", a, b, &detail, &tolerance, &nearBudget) >= 3)
+        toleranceMode(a, b, detail, tolerance, nearBudget);
+    else if(strcmp(mode, "-components") == 0 && sscanf(cmd, "%*s %127s %127s %i", a, b, &detail) >= 2)
+        componentsMode(a, b, detail);
+    else if(strcmp(mode, "-chunks") == 0 && sscanf(cmd, "%*s %127s %127s %i %127s %i", a, b, &detail, c, &split) >= 3)
+        chunksMode(a, b, detail, c, split);
+    else if(strcmp(mode, "-daemon") == 0 && sscanf(cmd, "%*s %127s %i %i %127s %i", a, &workers, &queueLimit, c, &cacheSize) >= 1)
+        daemonMode(a, workers, queueLimit, c, cacheSize);
+    else if(strcmp(mode, "-request") == 0 && sscanf(cmd, "%*s %127s %n", a, &offset) == 1 && offset > 0)
+        daemonRequest(a, cmd + offset);
+    else {
+        printf("Unknown command line: %s\n", cmd);
+        printf("Usage: MIMM.exe -delta <previous commands.txt or bmp> <image> <color key>\n");
+        printf("       MIMM.exe -sequence <frame pattern> <first frame> <frame count> <color key> [detail] [delta]\n");
+        printf("       MIMM.exe -search <image> <color key> <detail> [budget in ms]\n");
+        printf("       MIMM.exe -clone <image> <color key> <detail> [smallest repeat in pixels]\n");
+        printf("       MIMM.exe -requantize <image> <color key> <edited color key> [detail]\n");
+        printf("       MIMM.exe -adaptive <image> <color key> [error budget] [node]\n");
+        printf("       MIMM.exe -progressive <image> <color key> [detail]\n");
+        printf("       MIMM.exe -reduce <image> <color key> [detail] [blocks]\n");
+        printf("       MIMM.exe -convert <image> <color key> [detail, 0 for auto] [cache directory] [cache size in MB]\n");
+        printf("       MIMM.exe -mapitem <image> [first map id] [flat|staircase|all] [output directory]\n");
+        printf("       MIMM.exe -edit <image> <color key> <detail> <edits file> [map to write]\n");
+        printf("       MIMM.exe -tolerance <image> <color key> <detail> [tolerance] [error budget]\n");
+        printf("       MIMM.exe -components <image> <color key> [detail]\n");
+        printf("       MIMM.exe -chunks <image> <color key> <detail> [hilbert|serpentine] [split fills at chunk edges 0|1]\n");
+        printf("       MIMM.exe -daemon <socket path> [workers] [queue limit] [cache directory] [cache size in MB]\n");
+        printf("       MIMM.exe -request <socket path> <convert ...|stats|stop>\n");
+        printf("Convert, reduce, edit, tolerance, components and the daemon also take builtin:<name> as the color key, like builtin:wool.\n");
+    }
+    return 1;
 }
 
 LRESULT CALLBACK ContainerProc(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp) {
@@ -674,6 +548,11 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmd, int
     FILE *commands = NULL, *colors = NULL;
     HWND selectedWindow;
     WNDCLASSW wc = {}, containerClass = {}, displayClass = {};
+
+    if(runCommandLine(cmd))
+        return 0;
+    imageJobs = allocJobRunner(runImageRequest, printStage, NULL);
+
     wc.lpfnWndProc = WindowProc;
     wc.hInstance = hInstance;
     wc.lpszClassName = L"main";
@@ -707,6 +586,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmd, int
         else if(phase == 1 && GetAsyncKeyState(VK_CONTROL)) {
             phase = 2;
             selectedWindow = selectWindow();
+            waitForJobs(imageJobs); /* The latest image may still be writing its commands. */
             commands = fopen("commands.txt", "r");
             colors = fopen("pixelColors.txt", "r");
             clearDisplay(getDisplayDC(display), getDisplayScale(display));
@@ -725,6 +605,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR cmd, int
         fclose(colors);
     }
 
+    freeJobRunner(imageJobs);
     DestroyWindow(hwnd);
     UnregisterClassW(L"main", hInstance);
     return 0;
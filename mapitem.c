@@ -0,0 +1,600 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: mapitem.c
+
+Note: Many uses only need the finished map item, not the blocks in the world. Map item mode skips the commands entirely and writes
+the map_<id>.dat files a world keeps its maps in, so placing an image takes a file copy instead of minutes of commands.
+A map stores one color id for every pixel: the base color of the block times 4 plus its shade. Shades 0, 1 and 2 are what a block
+gives when the block north of it is higher, level or lower, so a build can only reach those. Shade 3 can only be in a file.
+The image is quantized against every base color in the shades asked for, with the same quantizePixels the commands use.
+Transparent pixels get color 0, which the map leaves see through.
+An image bigger than 128 by 128 is a wall of maps, cut into tiles from the top left, left to right then top to bottom, with the
+map ids counting up from the first id in the same order. Tiles hanging over the edge of the image are transparent there.
+The bmp is read a row at a time and only the 128 rows of one row of tiles are held at once. As soon as the last of them is read,
+every tile of that row is quantized, encoded and written on its own thread.
+The files are NBT compressed with gzip. The deflate data is made of stored blocks, which every gzip reader takes, so no compression
+library is needed. The maps are locked so the game never draws over them. idcounts.dat is written with the last id used, so the
+next map made in the world does not take one of these ids. It is read back first and only ever moved up, which takes a small
+inflate since the game compresses it.
+
+Timeline:
+20261019 - File created.
+20261019 - Tiles are cut out of the wall by wallTile.
+20261019 - idcounts.dat is read first and never set below the id already in it.
+20261019 - The wall is read a row of tiles at a time instead of all at once, and top down bmps are taken too.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "mapitem.h"
+#include "job.h"
+#include "palette.h"
+#include "parallel.h"
+
+#define NBT_END 0
+#define NBT_BYTE 1
+#define NBT_INT 3
+#define NBT_BYTE_ARRAY 7
+#define NBT_STRING 8
+#define NBT_LIST 9
+#define NBT_COMPOUND 10
+#define STORED_BLOCK 65535 /* Most bytes one stored deflate block can hold. */
+#define INFLATE_LIMIT (1 << 20) /* Largest file read back, far more than idcounts.dat ever needs. */
+
+const uint8_t mapBaseColors[MAP_BASE_COLORS][3] = { /* By base color id. */
+    {0, 0, 0}, {127, 178, 56}, {247, 233, 163}, {199, 199, 199}, {255, 0, 0}, {160, 160, 255}, {167, 167, 167}, {0, 124, 0},
+    {255, 255, 255}, {164, 168, 184}, {151, 109, 77}, {112, 112, 112}, {64, 64, 255}, {143, 119, 72}, {255, 252, 245}, {216, 127, 51},
+    {178, 76, 216}, {102, 153, 216}, {229, 229, 51}, {127, 204, 25}, {242, 127, 165}, {76, 76, 76}, {153, 153, 153}, {76, 127, 153},
+    {127, 63, 178}, {51, 76, 178}, {102, 76, 51}, {102, 127, 51}, {153, 51, 51}, {25, 25, 25}, {250, 238, 77}, {92, 219, 213},
+    {74, 128, 255}, {0, 217, 58}, {129, 86, 49}, {112, 2, 0}, {209, 177, 161}, {159, 82, 36}, {149, 87, 108}, {112, 108, 138},
+    {186, 133, 36}, {103, 117, 53}, {160, 77, 78}, {57, 41, 35}, {135, 107, 98}, {87, 92, 92}, {122, 73, 88}, {76, 62, 92},
+    {76, 50, 35}, {76, 82, 42}, {142, 60, 46}, {37, 22, 16}, {189, 48, 49}, {148, 63, 97}, {92, 25, 29}, {22, 126, 134},
+    {58, 142, 140}, {86, 44, 62}, {20, 180, 133}, {100, 100, 100}, {216, 175, 147}, {127, 167, 150}
+};
+const int shadeMultipliers[4] = {180, 220, 255, 135}; /* Out of 255, by shade. */
+
+struct ByteBuffer {
+    uint8_t *bytes;
+    int length;
+    int capacity;
+};
+
+struct MapWall {
+    uint32_t *band; /* The 128 rows of the row of tiles being exported, top row first. */
+    int top; /* The image row the band starts at. */
+    int width;
+    int height;
+    int columns; /* Tiles across. */
+    struct RGBColor *key; /* Every base color and shade the maps may use. */
+    uint8_t *ids; /* The map color id of every color in the key. */
+    int colors;
+    int firstId;
+    char *directory;
+    long *errors; /* By tile, summed over its pixels. */
+    int *opaque;
+    int *written;
+};
+
+void putBytes(struct ByteBuffer *b, const void *data, int n) {
+    if(b->length + n > b->capacity) {
+        b->capacity = (b->length + n) * 2;
+        b->bytes = realloc(b->bytes, b->capacity);
+    }
+    memcpy(b->bytes + b->length, data, n);
+    b->length += n;
+}
+
+void putByte(struct ByteBuffer *b, int value) {
+    uint8_t byte = value & 0xFF;
+    putBytes(b, &byte, 1);
+}
+
+void putInt(struct ByteBuffer *b, int value) { /* NBT is big endian. */
+    uint8_t bytes[4] = {(value >> 24) & 0xFF, (value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF};
+    putBytes(b, bytes, 4);
+}
+
+void nbtTag(struct ByteBuffer *b, int type, char *name) { /* The type and name every named tag starts with. */
+    int length = strlen(name);
+    putByte(b, type);
+    putByte(b, length >> 8);
+    putByte(b, length);
+    putBytes(b, name, length);
+}
+
+void nbtString(struct ByteBuffer *b, char *name, char *value) {
+    int length = strlen(value);
+    nbtTag(b, NBT_STRING, name);
+    putByte(b, length >> 8);
+    putByte(b, length);
+    putBytes(b, value, length);
+}
+
+void nbtEmptyList(struct ByteBuffer *b, char *name) {
+    nbtTag(b, NBT_LIST, name);
+    putByte(b, NBT_COMPOUND);
+    putInt(b, 0);
+}
+
+uint32_t crc32(uint8_t *data, int n) {
+    uint32_t crc = 0xFFFFFFFF;
+    int i, k;
+    for(i = 0 ; i < n ; i++) {
+        crc ^= data[i];
+        for(k = 0 ; k < 8 ; k++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+int writeGzip(char *path, uint8_t *data, int n) { /* Returns 0 if the file could not be written. */
+    uint8_t header[10] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF}, block[5], trailer[8];
+    uint32_t crc = crc32(data, n);
+    FILE *fw = fopen(path, "wb");
+    int done = 0, length, ok;
+
+    if(fw == NULL)
+        return 0;
+    fwrite(header, 1, 10, fw);
+    do { /* An empty file still needs one final block. */
+        length = n - done > STORED_BLOCK ? STORED_BLOCK:n - done;
+        block[0] = done + length == n; /* Final bit, block type 0 for stored. */
+        block[1] = length & 0xFF;
+        block[2] = length >> 8;
+        block[3] = ~length & 0xFF;
+        block[4] = (~length >> 8) & 0xFF;
+        fwrite(block, 1, 5, fw);
+        fwrite(data + done, 1, length, fw);
+        done += length;
+    } while(done < n);
+    trailer[0] = crc & 0xFF;
+    trailer[1] = (crc >> 8) & 0xFF;
+    trailer[2] = (crc >> 16) & 0xFF;
+    trailer[3] = crc >> 24;
+    trailer[4] = n & 0xFF;
+    trailer[5] = (n >> 8) & 0xFF;
+    trailer[6] = (n >> 16) & 0xFF;
+    trailer[7] = (n >> 24) & 0xFF;
+    fwrite(trailer, 1, 8, fw);
+    ok = !ferror(fw);
+    return fclose(fw) == 0 && ok;
+}
+
+struct Inflater { /* Just enough of inflate to read back the small gzip files a world keeps, like idcounts.dat. */
+    uint8_t *in;
+    int length;
+    int position;
+    uint32_t bits;
+    int bitCount;
+    struct ByteBuffer *out;
+};
+
+struct Huffman {
+    short count[16]; /* How many codes there are of each length. */
+    short symbol[288]; /* The symbols in the order of their codes. */
+};
+
+const short lengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+const short lengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+const short distanceBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577};
+const short distanceExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+int inflateBits(struct Inflater *s, int need) { /* The next 'need' bits, -1 past the end of the input. */
+    uint32_t value = s->bits;
+    while(s->bitCount < need) {
+        if(s->position >= s->length)
+            return -1;
+        value |= (uint32_t)s->in[s->position++] << s->bitCount;
+        s->bitCount += 8;
+    }
+    s->bits = value >> need;
+    s->bitCount -= need;
+    return value & ((1u << need) - 1);
+}
+
+void buildHuffman(struct Huffman *h, short *lengths, int n) { /* The canonical code of deflate, from the length of every symbol's code. */
+    short offsets[16];
+    int i;
+
+    memset(h->count, 0, sizeof(h->count));
+    for(i = 0 ; i < n ; i++)
+        h->count[lengths[i]]++;
+    offsets[1] = 0;
+    for(i = 1 ; i < 15 ; i++)
+        offsets[i + 1] = offsets[i] + h->count[i];
+    for(i = 0 ; i < n ; i++)
+        if(lengths[i] != 0)
+            h->symbol[offsets[lengths[i]]++] = i;
+}
+
+int inflateSymbol(struct Inflater *s, struct Huffman *h) { /* Reads a code a bit at a time, -1 if there is no such code. */
+    int code = 0, first = 0, index = 0, length, bit;
+    for(length = 1 ; length < 16 ; length++) {
+        if((bit = inflateBits(s, 1)) < 0)
+            return -1;
+        code |= bit;
+        if(code - h->count[length] < first)
+            return h->symbol[index + code - first];
+        index += h->count[length];
+        first = (first + h->count[length]) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+int inflateCodes(struct Inflater *s, struct Huffman *lengths, struct Huffman *distances) { /* One compressed block, returns 0 if it is broken. */
+    int symbol, length, distance, extra;
+    while(1) {
+        if((symbol = inflateSymbol(s, lengths)) < 0 || s->out->length > INFLATE_LIMIT)
+            return 0;
+        if(symbol < 256)
+            putByte(s->out, symbol);
+        else if(symbol == 256)
+            return 1;
+        else {
+            if((symbol -= 257) >= 29 || (extra = inflateBits(s, lengthExtra[symbol])) < 0)
+                return 0;
+            length = lengthBase[symbol] + extra;
+            if((symbol = inflateSymbol(s, distances)) < 0 || symbol >= 30 || (extra = inflateBits(s, distanceExtra[symbol])) < 0)
+                return 0;
+            if((distance = distanceBase[symbol] + extra) > s->out->length)
+                return 0;
+            while(length-- > 0)
+                putByte(s->out, s->out->bytes[s->out->length - distance]);
+        }
+    }
+}
+
+int inflateDynamic(struct Inflater *s) {
+    static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    struct Huffman lengths, distances;
+    short sizes[320];
+    int lengthCodes = inflateBits(s, 5) + 257, distanceCodes = inflateBits(s, 5) + 1, codes = inflateBits(s, 4) + 4;
+    int i = 0, symbol, repeat, size;
+
+    if(codes < 4 || distanceCodes < 1 || lengthCodes > 286 || distanceCodes > 30)
+        return 0;
+    memset(sizes, 0, sizeof(sizes));
+    for(i = 0 ; i < codes ; i++)
+        if((sizes[order[i]] = inflateBits(s, 3)) < 0)
+            return 0;
+    buildHuffman(&lengths, sizes, 19);
+
+    for(i = 0 ; i < lengthCodes + distanceCodes ; ) {
+        if((symbol = inflateSymbol(s, &lengths)) < 0)
+            return 0;
+        if(symbol < 16) {
+            sizes[i++] = symbol;
+            continue;
+        }
+        size = 0;
+        if(symbol == 16) { /* The size before, 3 to 6 times. */
+            if(i == 0)
+                return 0;
+            size = sizes[i - 1];
+            repeat = inflateBits(s, 2) + 3;
+        }
+        else
+            repeat = symbol == 17 ? inflateBits(s, 3) + 3:inflateBits(s, 7) + 11;
+        if(repeat < 3 || i + repeat > lengthCodes + distanceCodes)
+            return 0;
+        while(repeat-- > 0)
+            sizes[i++] = size;
+    }
+    buildHuffman(&lengths, sizes, lengthCodes);
+    buildHuffman(&distances, sizes + lengthCodes, distanceCodes);
+    return inflateCodes(s, &lengths, &distances);
+}
+
+int inflateFixed(struct Inflater *s) {
+    struct Huffman lengths, distances;
+    short sizes[288];
+    int i;
+
+    for(i = 0 ; i < 288 ; i++)
+        sizes[i] = i < 144 ? 8:i < 256 ? 9:i < 280 ? 7:8;
+    buildHuffman(&lengths, sizes, 288);
+    for(i = 0 ; i < 30 ; i++)
+        sizes[i] = 5;
+    buildHuffman(&distances, sizes, 30);
+    return inflateCodes(s, &lengths, &distances);
+}
+
+int inflateStored(struct Inflater *s) {
+    int length;
+    s->bits = 0; /* Stored data starts on the next byte. */
+    s->bitCount = 0;
+    if(s->position + 4 > s->length)
+        return 0;
+    length = s->in[s->position] | s->in[s->position + 1] << 8;
+    if((~length & 0xFFFF) != (s->in[s->position + 2] | s->in[s->position + 3] << 8) || s->position + 4 + length > s->length)
+        return 0;
+    if(length > 0)
+        putBytes(s->out, s->in + s->position + 4, length);
+    s->position += 4 + length;
+    return 1;
+}
+
+int readGzip(char *path, struct ByteBuffer *out) { /* Returns 1 with the file unpacked into 'out', 0 if there is no file and -1 if it can not be read. */
+    struct Inflater s;
+    FILE *fr = fopen(path, "rb");
+    uint8_t *in;
+    long length;
+    int flags, last = 0, type, ok = 1, crc;
+
+    if(fr == NULL)
+        return 0;
+    fseek(fr, 0, SEEK_END);
+    length = ftell(fr);
+    rewind(fr);
+    if(length < 18 || length > INFLATE_LIMIT) {
+        fclose(fr);
+        return -1;
+    }
+    in = malloc(length);
+    length = fread(in, 1, length, fr);
+    fclose(fr);
+
+    s.in = in;
+    s.length = length - 8; /* The crc and size trail the deflate data. */
+    s.position = 10;
+    s.bits = 0;
+    s.bitCount = 0;
+    s.out = out;
+    flags = in[3];
+    if(in[0] != 0x1F || in[1] != 0x8B || in[2] != 8)
+        ok = 0;
+    if(flags & 4) /* Extra field. */
+        s.position += 2 + (in[10] | in[11] << 8);
+    if(flags & 8) /* File name. */
+        while(s.position < s.length && in[s.position++] != 0);
+    if(flags & 16) /* Comment. */
+        while(s.position < s.length && in[s.position++] != 0);
+    if(flags & 2) /* Header crc. */
+        s.position += 2;
+
+    while(ok && !last) {
+        last = inflateBits(&s, 1);
+        type = inflateBits(&s, 2);
+        if(last < 0 || type < 0 || type == 3)
+            ok = 0;
+        else
+            ok = type == 0 ? inflateStored(&s):type == 1 ? inflateFixed(&s):inflateDynamic(&s);
+    }
+    crc = in[length - 8] | in[length - 7] << 8 | in[length - 6] << 16 | (uint32_t)in[length - 5] << 24;
+    ok = ok && (uint32_t)crc == crc32(out->bytes, out->length);
+    free(in);
+    return ok ? 1:-1;
+}
+
+int wallUsesAlpha(FILE *fr, struct BMPHeader *h) { /* Same as readPixels, an alpha byte that is 0 everywhere is not used. */
+    int i, j, used = 0, height = h->height < 0 ? -h->height:h->height, rowBytes = (h->width * 4 + 3) & ~3;
+    uint8_t *row;
+
+    if(h->bitsPerPixel != 32)
+        return 0;
+    row = malloc(rowBytes);
+    fseek(fr, h->offset, SEEK_SET);
+    for(i = 0 ; i < height && !used && fread(row, 1, rowBytes, fr) >= (size_t)(h->width * 4) ; i++)
+        for(j = 0 ; j < h->width && !used ; j++)
+            used = row[j * 4 + 3] != 0;
+    free(row);
+    return used;
+}
+
+void mapFile(struct ByteBuffer *b, uint8_t *colors) { /* The NBT of one map. */
+    nbtTag(b, NBT_COMPOUND, "");
+    nbtTag(b, NBT_COMPOUND, "data");
+    nbtTag(b, NBT_BYTE, "scale");
+    putByte(b, 0);
+    nbtString(b, "dimension", "minecraft:overworld");
+    nbtTag(b, NBT_BYTE, "trackingPosition");
+    putByte(b, 0);
+    nbtTag(b, NBT_BYTE, "unlimitedTracking");
+    putByte(b, 0);
+    nbtTag(b, NBT_BYTE, "locked");
+    putByte(b, 1);
+    nbtTag(b, NBT_INT, "xCenter");
+    putInt(b, 0);
+    nbtTag(b, NBT_INT, "zCenter");
+    putInt(b, 0);
+    nbtEmptyList(b, "banners");
+    nbtEmptyList(b, "frames");
+    nbtTag(b, NBT_BYTE_ARRAY, "colors");
+    putInt(b, 128 * 128);
+    putBytes(b, colors, 128 * 128);
+    putByte(b, NBT_END);
+    nbtTag(b, NBT_INT, "DataVersion");
+    putInt(b, MAP_DATA_VERSION);
+    putByte(b, NBT_END);
+}
+
+void wallTile(struct MapWall *w, int left, uint32_t *pixels) {
+    /* The 128 by 128 tile of the band whose left pixel is 'left', laid out the way readPixels leaves a bmp, bottom row first. */
+    int i, j, col;
+    for(i = 0 ; i < 128 ; i++)
+        for(j = 0 ; j < 128 ; j++) {
+            col = left + j;
+            pixels[(127 - i) * 128 + j] = w->top + i < w->height && col < w->width ? w->band[(long)i * w->width + col]:0;
+        }
+}
+
+void exportTile(void *context, int column) {
+    struct MapWall *w = context;
+    struct ByteBuffer b = {NULL, 0, 0};
+    struct Grid *grid = allocGrid(128, 128);
+    uint32_t *pixels = malloc(128 * 128 * sizeof(uint32_t));
+    uint8_t *colors = malloc(128 * 128);
+    int i, j, tile = w->top / 128 * w->columns + column;
+    char path[300];
+
+    wallTile(w, column * 128, pixels);
+    quantizePixels(pixels, w->key, w->colors, grid, NULL, NULL);
+
+    w->errors[tile] = 0;
+    w->opaque[tile] = 0;
+    for(i = 0 ; i < 128 ; i++)
+        for(j = 0 ; j < 128 ; j++) {
+            if(GRID(grid, i, j) == GRID_EMPTY) {
+                colors[i * 128 + j] = 0;
+                continue;
+            }
+            colors[i * 128 + j] = w->ids[GRID(grid, i, j)];
+            w->errors[tile] += getDiff(pixelToRGB(pixels[(127 - i) * 128 + j]), w->key[GRID(grid, i, j)]);
+            w->opaque[tile]++;
+        }
+
+    mapFile(&b, colors);
+    sprintf(path, "%s\\map_%i.dat", w->directory, w->firstId + tile);
+    w->written[tile] = !jobCancelled() && writeGzip(path, b.bytes, b.length);
+
+    free(b.bytes);
+    free(colors);
+    free(pixels);
+    freeGrid(grid);
+}
+
+int exportWall(FILE *fr, struct BMPHeader *h, struct MapWall *w) {
+    /* Reads the bmp a row at a time, top down or bottom up, and exports each row of tiles as soon as all of its rows are in.
+    Returns 0 if the file ended or the job was cancelled first. */
+    int i, j, y, bytes = h->bitsPerPixel / 8, rowBytes = (h->width * bytes + 3) & ~3, alpha = wallUsesAlpha(fr, h);
+    uint8_t *row = malloc(rowBytes), *p;
+
+    fseek(fr, h->offset, SEEK_SET);
+    for(i = 0 ; i < w->height && !jobCancelled() ; i++) {
+        if(fread(row, 1, rowBytes, fr) < (size_t)(h->width * bytes)) /* The last row may be missing its padding. */
+            break;
+        y = h->height < 0 ? i:w->height - 1 - i;
+        for(j = 0, p = row ; j < w->width ; j++, p += bytes)
+            w->band[(long)(y % 128) * w->width + j] = (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0] | (alpha ? (uint32_t)p[3] << 24:PIXEL_OPAQUE);
+        if(h->height < 0 ? y % 128 == 127 || y == w->height - 1:y % 128 == 0) { /* The last row of the band to be read. */
+            w->top = y / 128 * 128;
+            parallelFor(w->columns, exportTile, w);
+        }
+    }
+    free(row);
+    return i == w->height;
+}
+
+int readIdCounts(char *directory) { /* The last map id the world handed out, -1 if it has none yet and -2 if idcounts.dat can not be read. */
+    struct ByteBuffer b = {NULL, 0, 0};
+    uint8_t tag[6] = {NBT_INT, 0, 3, 'm', 'a', 'p'};
+    char path[300];
+    int i, result, id = -2;
+
+    sprintf(path, "%s\\idcounts.dat", directory);
+    if((result = readGzip(path, &b)) == 0)
+        id = -1;
+    for(i = 0 ; result > 0 && i + 10 <= b.length ; i++)
+        if(memcmp(b.bytes + i, tag, 6) == 0) {
+            id = b.bytes[i + 6] << 24 | b.bytes[i + 7] << 16 | b.bytes[i + 8] << 8 | b.bytes[i + 9];
+            break;
+        }
+    free(b.bytes);
+    return id;
+}
+
+int writeIdCounts(char *directory, int lastId) {
+    /* Never moves the counter back, a world with higher ids than these maps would hand them out again and overwrite its own maps. */
+    struct ByteBuffer b = {NULL, 0, 0};
+    char path[300];
+    int ok, existing = readIdCounts(directory);
+
+    if(existing == -2) {
+        printf("idcounts.dat is there but could not be read, so it is left alone. Make sure the next map id is above %i.\n", lastId);
+        return 1;
+    }
+    if(existing >= lastId)
+        return 1;
+
+    nbtTag(&b, NBT_COMPOUND, "");
+    nbtTag(&b, NBT_COMPOUND, "data");
+    nbtTag(&b, NBT_INT, "map");
+    putInt(&b, lastId);
+    putByte(&b, NBT_END);
+    nbtTag(&b, NBT_INT, "DataVersion");
+    putInt(&b, MAP_DATA_VERSION);
+    putByte(&b, NBT_END);
+
+    sprintf(path, "%s\\idcounts.dat", directory);
+    ok = writeGzip(path, b.bytes, b.length);
+    free(b.bytes);
+    return ok;
+}
+
+void mapItemMode(char *image, int firstId, char *shades, char *directory) {
+    FILE *fr = fopen(image, "rb");
+    struct BMPHeader h;
+    struct MapWall w;
+    int i, j, base, shade, tiles, rows, written = 0, set = MAP_SHADES_ALL, opaque = 0;
+    long error = 0;
+
+    if(fr != NULL)
+        h = readBMPHeader(fr);
+    if(fr == NULL || h.type != 0x4D42 || (h.bitsPerPixel != 24 && h.bitsPerPixel != 32) || h.width <= 0 || h.height == 0) {
+        printf("Map item mode could not read %s, it needs to be a 24 or 32 bit bmp.\n", image);
+        if(fr != NULL)
+            fclose(fr);
+        return;
+    }
+    w.width = h.width;
+    w.height = h.height < 0 ? -h.height:h.height;
+
+    if(strcmp(shades, "flat") == 0)
+        set = MAP_SHADES_FLAT;
+    else if(strcmp(shades, "staircase") == 0)
+        set = MAP_SHADES_STAIRCASE;
+    w.key = malloc(MAP_BASE_COLORS * 4 * sizeof(struct RGBColor));
+    w.ids = malloc(MAP_BASE_COLORS * 4);
+    w.colors = 0;
+    for(base = 1 ; base < MAP_BASE_COLORS ; base++)
+        for(shade = 0 ; shade < 4 ; shade++) {
+            if((set == MAP_SHADES_FLAT && shade != 1) || (set == MAP_SHADES_STAIRCASE && shade == 3))
+                continue;
+            w.key[w.colors].r = mapBaseColors[base][0] * shadeMultipliers[shade] / 255;
+            w.key[w.colors].g = mapBaseColors[base][1] * shadeMultipliers[shade] / 255;
+            w.key[w.colors].b = mapBaseColors[base][2] * shadeMultipliers[shade] / 255;
+            w.key[w.colors].a = 0;
+            w.ids[w.colors++] = base * 4 + shade;
+        }
+
+    w.columns = (w.width + 127) / 128;
+    rows = (w.height + 127) / 128;
+    tiles = w.columns * rows;
+    w.firstId = firstId;
+    w.directory = directory[0] != '\0' ? directory:".";
+    w.errors = calloc(tiles, sizeof(long)); /* Tiles the file ends before stay unwritten. */
+    w.opaque = calloc(tiles, sizeof(int));
+    w.written = calloc(tiles, sizeof(int));
+    w.band = malloc((long)w.width * 128 * sizeof(uint32_t));
+    CreateDirectoryA(w.directory, NULL); /* Fails harmlessly when it is already there. */
+
+    if(!exportWall(fr, &h, &w))
+        printf("%s ended early, some of its maps were not written.\n", image);
+    fclose(fr);
+
+    for(i = 0 ; i < tiles ; i++) {
+        written += w.written[i];
+        error += w.errors[i];
+        opaque += w.opaque[i];
+    }
+    printf("Wrote %i of %i maps to %s, %i by %i, %i colors, mean error %.1f per pixel.\n", written, tiles, w.directory, w.columns, rows, w.colors, opaque > 0 ? (double)error / opaque:0);
+    printf("Map ids, left to right and top to bottom:\n");
+    for(i = 0 ; i < rows ; i++) {
+        for(j = 0 ; j < w.columns ; j++)
+            printf("%6i", firstId + i * w.columns + j);
+        printf("\n");
+    }
+    if(written == tiles && !writeIdCounts(w.directory, firstId + tiles - 1))
+        printf("Could not write idcounts.dat.\n");
+
+    free(w.band);
+    free(w.key);
+    free(w.ids);
+    free(w.errors);
+    free(w.opaque);
+    free(w.written);
+}
@@ -0,0 +1,21 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: mapitem.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef MAPITEM_H
+#define MAPITEM_H
+
+#define MAP_BASE_COLORS 62 /* Base color 0 is transparent. */
+#define MAP_DATA_VERSION 3465 /* 1.20.1, newer versions upgrade the files when they load them. */
+#define MAP_SHADES_FLAT 0 /* Only the shade a flat floor of blocks gives. */
+#define MAP_SHADES_STAIRCASE 1 /* The three shades blocks can be stepped up and down to give. */
+#define MAP_SHADES_ALL 2 /* Includes the darkest shade, which only map files can hold. */
+
+void mapItemMode(char *image, int firstId, char *shades, char *directory);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: mimm.c
+
+Note: mimm.dll, the converter without the window, the command line or any files. See mimm.h.
+A conversion runs the same pipeline as MIMM.exe: the pixels are matched to the palette straight from the caller's buffer,
+then the quad, then the optimizer or the auto tuner. The pipeline keeps all its state on the stack or in what it allocates,
+so contexts on different threads never share anything. The conversion runs as the context's job, which is how mimmCancel
+stops it from another thread and how the progress callback gets called.
+The plan is kept as one array of MimmCommand the context owns and grows as needed, so reading it takes no allocation at all.
+
+Timeline:
+20261019 - File created.
+20261019 - The auto tuner runs quietly, the library does not write to stdout.
+20261019 - Added mimmShutdown.
+*/
+
+#include <windows.h>
+#include <string.h>
+#include "mimm.h"
+#include "commands.h"
+#include "job.h"
+#include "palette.h"
+#include "parallel.h"
+#include "quad.h"
+#include "tolerance.h"
+#include "tune.h"
+
+struct MimmContext {
+    struct RGBColor *key;
+    int colors;
+    int detail; /* 0 lets the auto tuner pick. */
+    int tolerance; /* 0 merges nothing. */
+    long budget;
+    struct Job job;
+    struct Grid *grid;
+    struct Grid *target; /* What the plan places. */
+    MimmCommand *commands;
+    int count; /* Commands in the plan, or a MIMM_ERROR code when there is none. */
+    int capacity;
+    int used; /* The level of detail the plan was made at. */
+};
+
+char *mimmStatusTexts[] = {"OK", "Bad argument", "Out of memory", "No palette set", "No plan", "Buffer too small", "Cancelled"};
+
+int mimmVersion(void) {
+    return MIMM_API_VERSION;
+}
+
+const char* mimmStatusText(int status) {
+    if(status > 0)
+        status = MIMM_OK;
+    if(status < MIMM_ERROR_CANCELLED)
+        return "Unknown status";
+    return mimmStatusTexts[-status];
+}
+
+MimmContext* mimmCreate(void) {
+    MimmContext *c = calloc(1, sizeof(MimmContext));
+    if(c == NULL)
+        return NULL;
+    c->grid = allocGrid(MIMM_MAP_SIZE, MIMM_MAP_SIZE);
+    c->target = allocGrid(MIMM_MAP_SIZE, MIMM_MAP_SIZE);
+    c->detail = 1;
+    c->budget = TOLERANCE_ERROR_BUDGET;
+    c->count = MIMM_ERROR_NO_PLAN;
+    initJob(&c->job, NULL, NULL);
+    return c;
+}
+
+void mimmDestroy(MimmContext *c) {
+    if(c == NULL)
+        return;
+    freeGrid(c->grid);
+    freeGrid(c->target);
+    free(c->key);
+    free(c->commands);
+    free(c);
+}
+
+void mimmShutdown(void) { /* Ends the worker threads conversions share, see mimm.h. The next conversion starts them again. */
+    stopPool();
+}
+
+int mimmSetPalette(MimmContext *c, const uint8_t *rgb, int colors) { /* 'colors' colors of 3 bytes each: red, green, blue. */
+    struct RGBColor *key;
+    int i;
+
+    if(c == NULL || rgb == NULL || colors <= 0 || colors > GRID_MAX_COLORS)
+        return MIMM_ERROR_ARGUMENT;
+    if((key = malloc(colors * sizeof(struct RGBColor))) == NULL)
+        return MIMM_ERROR_MEMORY;
+    for(i = 0 ; i < colors ; i++) {
+        key[i].r = rgb[3 * i];
+        key[i].g = rgb[3 * i + 1];
+        key[i].b = rgb[3 * i + 2];
+        key[i].a = 0;
+    }
+    free(c->key);
+    c->key = key;
+    c->colors = colors;
+    return MIMM_OK;
+}
+
+int mimmSetBuiltinPalette(MimmContext *c, const char *name) { /* One of the bundled color keys by name, like "wool". Returns its colors. */
+    struct BuiltinPalette *b;
+    struct RGBColor *key;
+
+    if(c == NULL || name == NULL || (b = findBuiltinPalette((char*)name)) == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    if((key = malloc(b->colors * sizeof(struct RGBColor))) == NULL)
+        return MIMM_ERROR_MEMORY;
+    memcpy(key, b->key, b->colors * sizeof(struct RGBColor)); /* keyMatcher still finds its generated matcher by the colors. */
+    free(c->key);
+    c->key = key;
+    c->colors = b->colors;
+    return c->colors;
+}
+
+int mimmSetDetail(MimmContext *c, int detail) { /* A power of two up to MIMM_MAP_SIZE, or 0 for the auto tuner. */
+    if(c == NULL || detail < 0 || detail > MIMM_MAP_SIZE || (detail & (detail - 1)) != 0)
+        return MIMM_ERROR_ARGUMENT;
+    c->detail = detail;
+    return MIMM_OK;
+}
+
+int mimmSetTolerance(MimmContext *c, int tolerance, long budget) { /* Lets near colors merge, see tolerance.c. Only used at a fixed level of detail. */
+    if(c == NULL || tolerance < 0 || budget < 0)
+        return MIMM_ERROR_ARGUMENT;
+    c->tolerance = tolerance;
+    c->budget = budget;
+    return MIMM_OK;
+}
+
+int mimmSetProgress(MimmContext *c, MimmProgress progress, void *user) { /* The stages are the JOB_ stages of job.h. */
+    if(c == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    initJob(&c->job, progress, user);
+    return MIMM_OK;
+}
+
+void matchPixels(MimmContext *c, const uint8_t *pixels, int width, int height, int stride, int format) {
+    /* Matches the caller's pixels into the grid the way decodeQuantize matches a bmp. Anything past the image is empty. */
+    ColorMatcher match = keyMatcher(c->key, c->colors);
+    struct RGBColor rgb = {0, 0, 0, 0}, last = {0, 0, 0, 0};
+    const uint8_t *p;
+    int i, j, bytes = format == MIMM_FORMAT_RGB ? 3:4, lastColor = -1;
+
+    clearGrid(c->grid);
+    for(i = 0 ; i < height && !jobCancelled() ; i++) {
+        if(i % 16 == 0)
+            reportProgress(JOB_QUANTIZE, i, height);
+        for(j = 0, p = pixels + (size_t)i * stride ; j < width ; j++, p += bytes) {
+            if(bytes == 4 && p[3] < ALPHA_CUTOFF)
+                continue;
+            rgb.r = format == MIMM_FORMAT_BGRA ? p[2]:p[0];
+            rgb.g = p[1];
+            rgb.b = format == MIMM_FORMAT_BGRA ? p[0]:p[2];
+            if(lastColor < 0 || rgb.r != last.r || rgb.g != last.g || rgb.b != last.b) {
+                lastColor = match(rgb, c->key, c->colors);
+                last = rgb;
+            }
+            GRID(c->grid, i, j) = lastColor;
+        }
+    }
+    reportProgress(JOB_QUANTIZE, height, height);
+}
+
+int keepPlan(MimmContext *c, struct LinkedList *plan) { /* Moves the plan into the context's array and frees the list. */
+    int n = queueLength(plan), i = 0;
+    MimmCommand *grown;
+    struct Marker *m;
+
+    if(n > c->capacity) {
+        if((grown = realloc(c->commands, n * sizeof(MimmCommand))) == NULL) {
+            freeQueue(plan);
+            return MIMM_ERROR_MEMORY;
+        }
+        c->commands = grown;
+        c->capacity = n;
+    }
+    while(!LL_empty(plan)) {
+        m = LL_removeHead(plan);
+        c->commands[i].startCol = m->startCol;
+        c->commands[i].startRow = m->startRow;
+        c->commands[i].endCol = m->endCol;
+        c->commands[i].endRow = m->endRow;
+        c->commands[i].color = m->colorKey;
+        i++;
+        free(m);
+    }
+    return n;
+}
+
+/*
+Converts one map of pixels, top row first, 'stride' bytes from the start of one row to the next. Images smaller than a map
+are placed in its top left corner and the rest is left empty. Returns how many commands the plan has.
+*/
+int mimmConvert(MimmContext *c, const uint8_t *pixels, int width, int height, int stride, int format) {
+    struct LinkedList plan = {NULL, NULL};
+    struct MergeReport report;
+    struct Job *previous;
+    struct Quad q;
+
+    if(c == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    c->count = MIMM_ERROR_NO_PLAN;
+    if(pixels == NULL || width <= 0 || height <= 0 || width > MIMM_MAP_SIZE || height > MIMM_MAP_SIZE
+        || format < MIMM_FORMAT_RGB || format > MIMM_FORMAT_BGRA || stride < width * (format == MIMM_FORMAT_RGB ? 3:4))
+        return MIMM_ERROR_ARGUMENT;
+    if(c->key == NULL)
+        return MIMM_ERROR_NO_PALETTE;
+
+    InterlockedExchange((volatile LONG*)&c->job.cancelled, 0);
+    previous = beginJob(&c->job);
+    reportProgress(JOB_READ, 1, 1);
+    matchPixels(c, pixels, width, height, stride, format);
+    q = buildQuadExact(c->grid, c->colors, MIMM_MAP_SIZE);
+    if(jobCancelled())
+        c->used = c->detail;
+    else if(c->detail == 0)
+        c->used = autoTune(&q, c->grid, c->colors, TUNE_ERROR_BUDGET, 0, &plan);
+    else {
+        c->used = c->detail;
+        quad(&q, &plan, NULL, c->detail, 0);
+        if(c->tolerance > 0)
+            optimizeCommandsNear(&plan, c->key, c->colors, c->detail, c->tolerance, c->budget, &report);
+        else
+            optimizeCommands(&plan, c->colors, c->detail);
+    }
+    destroyQuad(&q);
+
+    if(jobCancelled()) { /* Whatever got made is only part of a plan. */
+        freeQueue(&plan);
+        endJob(previous);
+        return MIMM_ERROR_CANCELLED;
+    }
+    reportProgress(JOB_WRITE, 0, 1);
+    imprintGrid(&plan, c->target);
+    c->count = keepPlan(c, &plan);
+    reportProgress(JOB_WRITE, 1, 1);
+    endJob(previous);
+    return c->count;
+}
+
+void mimmCancel(MimmContext *c) { /* Safe from any thread. The conversion running on 'c' returns MIMM_ERROR_CANCELLED soon after. */
+    if(c != NULL)
+        cancelJob(&c->job);
+}
+
+int mimmDetail(MimmContext *c) { /* The level of detail of the last plan, which is the one the auto tuner picked when the detail is 0. */
+    if(c == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    return c->count < 0 ? c->count:c->used;
+}
+
+int mimmPlan(MimmContext *c, const MimmCommand **commands) { /* Points at the plan in place, valid until the next mimmConvert. */
+    if(c == NULL || commands == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    *commands = c->count < 0 ? NULL:c->commands;
+    return c->count;
+}
+
+int mimmCopyPlan(MimmContext *c, MimmCommand *buffer, int capacity) {
+    /* Copies the plan into the caller's buffer and returns how many commands it holds. With too small a buffer nothing is
+    copied and MIMM_ERROR_BUFFER is returned, mimmPlan gives the size to allocate. */
+    if(c == NULL || capacity < 0 || (buffer == NULL && capacity > 0))
+        return MIMM_ERROR_ARGUMENT;
+    if(c->count < 0)
+        return c->count;
+    if(capacity < c->count)
+        return MIMM_ERROR_BUFFER;
+    memcpy(buffer, c->commands, c->count * sizeof(MimmCommand));
+    return c->count;
+}
+
+int mimmTarget(MimmContext *c, uint8_t *cells) { /* MIMM_MAP_SIZE by MIMM_MAP_SIZE palette indices of what the plan places, top row first. */
+    int i;
+    if(c == NULL || cells == NULL)
+        return MIMM_ERROR_ARGUMENT;
+    if(c->count < 0)
+        return c->count;
+    for(i = 0 ; i < MIMM_MAP_SIZE ; i++)
+        memcpy(cells + i * MIMM_MAP_SIZE, &GRID(c->target, i, 0), MIMM_MAP_SIZE);
+    return MIMM_OK;
+}
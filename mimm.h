@@ -0,0 +1,93 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: mimm.h
+
+Note: The interface of mimm.dll, for programs that want to make plans without running MIMM.exe or touching any files.
+Everything goes through a context. A context holds its own palette, settings and last plan, so any number of contexts can
+convert at the same time on different threads. One context must only be used by one thread at a time, except for mimmCancel.
+Only one conversion at a time spreads its work over the cores. Conversions that start while it runs do all their work on the
+thread that called them, one core each.
+The worker threads are started by the first conversion that needs them and kept for the next ones. A program that unloads
+mimm.dll with FreeLibrary has to call mimmShutdown first, once no conversion is running, or those threads are left running
+code that is gone. Nothing else is needed when the program just exits.
+Pixels and palettes are copied in from the caller's memory. A plan is kept in the context until the next conversion or
+mimmDestroy, and can be read in place with mimmPlan or copied into the caller's own buffer with mimmCopyPlan.
+Functions that can fail return a MIMM_ERROR code, which is always negative.
+
+Timeline:
+20261019 - File created.
+20261019 - Notes that only one conversion at a time runs on more than one core.
+20261019 - Added mimmShutdown.
+*/
+
+#ifndef MIMM_H
+#define MIMM_H
+
+#include <stdint.h>
+
+#if defined(_WIN32) && defined(MIMM_BUILD)
+#define MIMM_EXPORT __declspec(dllexport)
+#elif defined(_WIN32)
+#define MIMM_EXPORT __declspec(dllimport)
+#else
+#define MIMM_EXPORT
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MIMM_API_VERSION 1 /* Goes up whenever anything below changes in a way older callers would notice. */
+#define MIMM_MAP_SIZE 128 /* Pixels across a map, the most one conversion takes. */
+#define MIMM_EMPTY 255 /* A cell of mimmTarget nothing is placed on. */
+
+#define MIMM_OK 0
+#define MIMM_ERROR_ARGUMENT -1 /* NULL where something was needed, or a size or setting out of range. */
+#define MIMM_ERROR_MEMORY -2
+#define MIMM_ERROR_NO_PALETTE -3 /* Nothing to convert with until mimmSetPalette or mimmSetBuiltinPalette succeeds. */
+#define MIMM_ERROR_NO_PLAN -4 /* Nothing converted yet, or the last conversion failed. */
+#define MIMM_ERROR_BUFFER -5 /* The caller's buffer is too small for the plan. mimmPlan gives how many commands it holds. */
+#define MIMM_ERROR_CANCELLED -6
+
+#define MIMM_FORMAT_RGB 0 /* 3 bytes a pixel: red, green, blue. */
+#define MIMM_FORMAT_RGBA 1 /* 4 bytes a pixel: red, green, blue, alpha. Alpha under 128 is left empty. */
+#define MIMM_FORMAT_BGRA 2 /* 4 bytes a pixel, the order Windows bitmaps use. */
+
+typedef struct MimmContext MimmContext;
+
+typedef struct MimmCommand { /* One fill, corners included, with (0, 0) the top left pixel of the map. */
+    int32_t startCol;
+    int32_t startRow;
+    int32_t endCol;
+    int32_t endRow;
+    int32_t color; /* Index into the palette. */
+} MimmCommand;
+
+typedef void (*MimmProgress)(void *user, int stage, int done, int total); /* Can be called from any thread the conversion uses. */
+
+MIMM_EXPORT int mimmVersion(void);
+MIMM_EXPORT const char* mimmStatusText(int status);
+
+MIMM_EXPORT MimmContext* mimmCreate(void);
+MIMM_EXPORT void mimmDestroy(MimmContext *c);
+MIMM_EXPORT void mimmShutdown(void);
+
+MIMM_EXPORT int mimmSetPalette(MimmContext *c, const uint8_t *rgb, int colors);
+MIMM_EXPORT int mimmSetBuiltinPalette(MimmContext *c, const char *name);
+MIMM_EXPORT int mimmSetDetail(MimmContext *c, int detail);
+MIMM_EXPORT int mimmSetTolerance(MimmContext *c, int tolerance, long budget);
+MIMM_EXPORT int mimmSetProgress(MimmContext *c, MimmProgress progress, void *user);
+
+MIMM_EXPORT int mimmConvert(MimmContext *c, const uint8_t *pixels, int width, int height, int stride, int format);
+MIMM_EXPORT void mimmCancel(MimmContext *c);
+MIMM_EXPORT int mimmDetail(MimmContext *c);
+MIMM_EXPORT int mimmPlan(MimmContext *c, const MimmCommand **commands);
+MIMM_EXPORT int mimmCopyPlan(MimmContext *c, MimmCommand *buffer, int capacity);
+MIMM_EXPORT int mimmTarget(MimmContext *c, uint8_t *cells);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
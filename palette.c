@@ -0,0 +1,360 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: palette.c
+
+Note: Functions for reading color keys and matching pixels to the colors in them.
+These were transfered over from main.c so modes without a window can use them.
+
+Timeline:
+20261019 - File created. Transfered functions over from main file. Added quantizeImage.
+Color key values are now scanned into ints before being stored in the 8 bit RGB fields.
+20261019 - Added getKeyColors and matchColorIndex so pixels can be matched without rereading the key file for every pixel.
+quantizeImage is split into readPixels and quantizePixels, which can reuse the colors of a previous frame.
+20261019 - Colors are matched into the new contiguous grid.
+20261019 - Added nearestColorIndex, which also gives back how far the pixel is from the color it matched.
+20261019 - readPixels seeks to the pixel data and marks pixels opaque when the image has no real alpha.
+quantizePixels masks out transparent pixels as GRID_EMPTY.
+20261019 - quantizePixels uses the generated matcher when the key is one of the built in palettes. Added loadColorKey,
+which takes a built in palette from memory instead of reading its csv.
+20261019 - quantizePixels reports its progress and stops early when the current job is cancelled.
+20261019 - Added decodeQuantize, which matches the rows of the bmp as they are read. quantizeImage uses it, so 'pixels' is only
+filled when the caller wants them.
+20261019 - Added colorKeyFits. loadColorKey turns down keys with more colors than a grid holds.
+20261019 - Built in palettes are only taken when asked for by name with BUILTIN_PREFIX, a csv with the same file name is read.
+*/
+
+#include <string.h>
+#include "palette.h"
+#include "job.h"
+
+int getDiff(struct RGBColor c1, struct RGBColor c2) {
+    return (c1.r > c2.r ? (c1.r - c2.r):(c2.r - c1.r)) + (c1.g > c2.g ? (c1.g - c2.g):(c2.g - c1.g)) + (c1.b > c2.b ? (c1.b - c2.b):(c2.b - c1.b));
+}
+
+int selectColorIndex(struct RGBColor compare, FILE *colorKey) {
+    char block[128], blockBuffer[128];
+    int line = 0, index = 0, diff, diffBuffer, r, g, b;
+    struct RGBColor rgb, rgbBuffer;
+
+    rewind(colorKey);
+    fscanf(colorKey, "%i,%i,%i,%s", &r, &g, &b, block);
+    rgb.r = r;
+    rgb.g = g;
+    rgb.b = b;
+    diff = getDiff(compare, rgb);
+    while(fscanf(colorKey, "%i,%i,%i,%s", &r, &g, &b, blockBuffer) != EOF) { /* I use buffer values for the buffer itself since somehow rgb kept getting zeroed out when rgbBuffer was used directly. */
+        line++;
+        rgbBuffer.r = r;
+        rgbBuffer.g = g;
+        rgbBuffer.b = b;
+        diffBuffer = getDiff(compare, rgbBuffer);
+        if(diffBuffer < diff) {
+            rgb = rgbBuffer;
+            strcpy(block, blockBuffer);
+            diff = diffBuffer;
+            index = line;
+        }
+    }
+
+    return index;
+}
+
+int amountOfColors(FILE *colorKey) {
+    int i1, i2, i3, n = 0;
+    char s[128];
+
+    rewind(colorKey);
+    while(fscanf(colorKey, "%i,%i,%i,%s", &i1, &i2, &i3, s) != EOF) /* Figuring out how many colors should be in the key. */
+        n++;
+    return n;
+}
+
+int colorKeyFits(FILE *colorKey, char *path) { /* Every color needs an index below GRID_EMPTY, so a key can have GRID_MAX_COLORS at most. */
+    int n = amountOfColors(colorKey);
+    if(n > GRID_MAX_COLORS) {
+        printf("The color key %s has %i colors, a map can hold at most %i.\n", path, n, GRID_MAX_COLORS);
+        return 0;
+    }
+    return 1;
+}
+
+char** getColorNames(FILE *colorKey, int n) {
+    int i = 0, i1, i2, i3;
+    char **colors;
+    
+    colors = malloc((n + 1) * sizeof(char*));
+    rewind(colorKey);
+    for(i = 0 ; i < n ; i++) {
+        colors[i] = malloc(128 * sizeof(char));
+        fscanf(colorKey, "%i,%i,%i,%s", &i1, &i2, &i3, colors[i]);
+    }
+    colors[n] = NULL;
+    return colors;
+}
+
+void freeColorNames(char **colors) {
+    int i;
+    for(i = 0 ; colors[i] != NULL ; i++)
+        free(colors[i]);
+    free(colors);
+}
+
+uint32_t* getPixelKey(FILE *colorKey, int n) {
+    int i = 0, r, g, b;
+    char buffer[128];
+    struct RGBColor rgb;
+    uint32_t *pixels = malloc(n * sizeof(uint32_t));
+    
+    rewind(colorKey);
+    for(i = 0 ; i < n ; i++) {
+        fscanf(colorKey, "%i,%i,%i,%s", &r, &g, &b, buffer);
+        rgb.r = r;
+        rgb.g = g;
+        rgb.b = b;
+        pixels[i] = rgbToPixel(rgb);
+    }
+
+    return pixels;
+}
+
+struct RGBColor* getKeyColors(FILE *colorKey, int n) {
+    int i = 0, r, g, b;
+    char buffer[128];
+    struct RGBColor *key = malloc(n * sizeof(struct RGBColor));
+
+    rewind(colorKey);
+    for(i = 0 ; i < n ; i++) {
+        fscanf(colorKey, "%i,%i,%i,%s", &r, &g, &b, buffer);
+        key[i].r = r;
+        key[i].g = g;
+        key[i].b = b;
+        key[i].a = 0;
+    }
+
+    return key;
+}
+
+int nearestColorIndex(struct RGBColor compare, struct RGBColor *key, int n, int *diff) { /* Same as selectColorIndex, but with the key already in memory. */
+    int i, index = 0, best = getDiff(compare, key[0]), diffBuffer;
+
+    for(i = 1 ; i < n ; i++) {
+        diffBuffer = getDiff(compare, key[i]);
+        if(diffBuffer < best) { /* Only a strictly closer color wins, so ties go to the earlier line like before. */
+            best = diffBuffer;
+            index = i;
+        }
+    }
+
+    if(diff != NULL)
+        *diff = best;
+    return index;
+}
+
+int matchColorIndex(struct RGBColor compare, struct RGBColor *key, int n) {
+    return nearestColorIndex(compare, key, n, NULL);
+}
+
+struct BuiltinPalette* findBuiltinPalette(char *name) { /* By the name of the csv it was made from, with or without ".csv". */
+    size_t length = strlen(name);
+    int i;
+
+    for(i = 0 ; i < builtinPaletteCount ; i++) {
+        if(strcmp(builtinPalettes[i].file, name) == 0 || (strncmp(builtinPalettes[i].file, name, length) == 0 && strcmp(builtinPalettes[i].file + length, ".csv") == 0))
+            return &builtinPalettes[i];
+    }
+    return NULL;
+}
+
+ColorMatcher keyMatcher(struct RGBColor *key, int n) { /* The generated matcher when the key holds the same colors as a built in palette. */
+    int i, j;
+
+    for(i = 0 ; i < builtinPaletteCount ; i++) {
+        if(builtinPalettes[i].colors != n)
+            continue;
+        for(j = 0 ; j < n && getDiff(key[j], builtinPalettes[i].key[j]) == 0 ; j++);
+        if(j == n)
+            return builtinPalettes[i].match;
+    }
+    return matchColorIndex;
+}
+
+int loadColorKey(char *path, char ***names, struct RGBColor **key, uint32_t **pixelKey) {
+    /* Loads the names, colors and pixel colors of a key, returns how many colors it has or 0 if it could not be loaded.
+    A path starting with BUILTIN_PREFIX names a built in palette. Any other path is read from its file, even when it is a copy of
+    a bundled key, so an edited key is never swapped for the compiled one. Its colors still get the generated matcher from keyMatcher. */
+    struct BuiltinPalette *b = NULL;
+    FILE *colorKey;
+    int i, n;
+
+    if(strncmp(path, BUILTIN_PREFIX, strlen(BUILTIN_PREFIX)) == 0 && (b = findBuiltinPalette(path + strlen(BUILTIN_PREFIX))) == NULL)
+        return 0;
+    if(b != NULL) { /* Copied so the caller frees them the same way either way. */
+        n = b->colors;
+        *names = malloc((n + 1) * sizeof(char*));
+        for(i = 0 ; i < n ; i++) {
+            (*names)[i] = malloc(128 * sizeof(char));
+            strcpy((*names)[i], b->names[i]);
+        }
+        (*names)[n] = NULL;
+        *key = malloc(n * sizeof(struct RGBColor));
+        memcpy(*key, b->key, n * sizeof(struct RGBColor));
+        *pixelKey = malloc(n * sizeof(uint32_t));
+        memcpy(*pixelKey, b->pixelKey, n * sizeof(uint32_t));
+        return n;
+    }
+
+    if((colorKey = fopen(path, "r")) == NULL)
+        return 0;
+    if(!colorKeyFits(colorKey, path)) {
+        fclose(colorKey);
+        return 0;
+    }
+    n = amountOfColors(colorKey);
+    *names = getColorNames(colorKey, n);
+    *key = getKeyColors(colorKey, n);
+    *pixelKey = getPixelKey(colorKey, n);
+    fclose(colorKey);
+    return n;
+}
+
+void readPixels(FILE *fr, uint32_t *pixels) {
+    int transparency = 0, i;
+    uint32_t alpha = 0;
+    struct BMPHeader h = readBMPHeader(fr);
+
+    if(h.bitsPerPixel > 24)
+        transparency = 1;
+
+    fseek(fr, h.offset, SEEK_SET); /* 32 bit images usually have a bigger header, so the pixels do not always start right after ours. */
+    for(i = 0 ; i < 128 * 128 ; i++) {
+        pixels[i] = readPixel(fr, transparency);
+        alpha |= pixels[i];
+    }
+
+    if(PIXEL_ALPHA(alpha) == 0) /* No transparency data, or every alpha is 0 which means the alpha byte is not used. */
+        for(i = 0 ; i < 128 * 128 ; i++)
+            pixels[i] |= PIXEL_OPAQUE;
+}
+
+/*
+Matches every pixel to a color in the key and returns how many pixels were reused.
+When a previous frame is given, any pixel that is the same as in the previous frame takes its color from the previous grid.
+Pixels under ALPHA_CUTOFF become GRID_EMPTY, so nothing has to be placed there.
+When the current job is cancelled it stops after the row it is on and the rest of the grid is left as it was.
+*/
+int quantizePixels(uint32_t *pixels, struct RGBColor *key, int n, struct Grid *grid, uint32_t *previousPixels, struct Grid *previousGrid) {
+    int i, j, p, reused = 0;
+    ColorMatcher match = keyMatcher(key, n);
+
+    for(i = 0 ; i < 128 && !jobCancelled() ; i++) {
+        if(i % 16 == 0)
+            reportProgress(JOB_QUANTIZE, i, 128);
+        for(j = 0 ; j < 128 ; j++) {
+            p = (127 - i) * 128 + j;
+            if(previousPixels != NULL && previousPixels[p] == pixels[p]) {
+                GRID(grid, i, j) = GRID(previousGrid, i, j);
+                reused++;
+            }
+            else if(PIXEL_ALPHA(pixels[p]) < ALPHA_CUTOFF)
+                GRID(grid, i, j) = GRID_EMPTY;
+            else
+                GRID(grid, i, j) = match(pixelToRGB(pixels[p]), key, n);
+        }
+    }
+    reportProgress(JOB_QUANTIZE, i, 128);
+
+    return reused;
+}
+
+/*
+Reads the pixels of a 24 or 32 bit bmp whose header 'h' was just read and matches them to the key a row at a time, so the image
+is never held in memory. Rows can be stored bottom up or top down. Row 0 of the grid is the top of the image, the same as
+quantizePixels. Parts of the grid the image does not reach are GRID_EMPTY, and pixels that do not fit in the grid are skipped.
+Most images repeat the pixel before often enough that its match is reused.
+Whether the alpha byte is used is only known once a pixel has some alpha. Until then every pixel has an alpha of 0, so if one does
+turn up, the pixels before it are masked out afterwards. This gives the same grid as readPixels and quantizePixels.
+When 'preview' is given it gets the pixels the way readPixels lays them out, bottom row first, grid width across.
+Returns 0 if the bmp is not one it can read.
+*/
+int decodeQuantize(FILE *fr, struct BMPHeader *h, struct RGBColor *key, int n, struct Grid *grid, uint32_t *preview) {
+    ColorMatcher match = keyMatcher(key, n);
+    struct RGBColor rgb = {0, 0, 0, 0}, last = {0, 0, 0, 0};
+    uint8_t *row, *p, alpha = 0xFF;
+    int i, j, y, bytes = h->bitsPerPixel / 8, height = h->height < 0 ? -h->height:h->height, rowBytes, across, lastColor = -1;
+    int alphaRow = -1, alphaCol = 0; /* The first pixel with any alpha, in the order they are read. */
+    uint32_t pixel;
+
+    clearGrid(grid);
+    if(preview != NULL)
+        memset(preview, 0, (size_t)grid->width * grid->height * sizeof(uint32_t));
+    if(h->type != 0x4D42 || (bytes != 3 && bytes != 4) || h->width <= 0 || height == 0)
+        return 0;
+
+    rowBytes = (h->width * bytes + 3) & ~3; /* Every row is padded to a multiple of 4 bytes. */
+    across = h->width < grid->width ? h->width:grid->width;
+    row = malloc(rowBytes);
+    fseek(fr, h->offset, SEEK_SET);
+
+    for(i = 0 ; i < height && !jobCancelled() ; i++) {
+        if(i % 16 == 0)
+            reportProgress(JOB_QUANTIZE, i, height);
+        y = h->height < 0 ? i:height - 1 - i;
+        if(y >= grid->height) {
+            fseek(fr, rowBytes, SEEK_CUR);
+            continue;
+        }
+        if(fread(row, 1, rowBytes, fr) < (size_t)(h->width * bytes)) /* The last row may be missing its padding. */
+            break;
+
+        for(j = 0, p = row ; j < across ; j++, p += bytes) {
+            rgb.b = p[0];
+            rgb.g = p[1];
+            rgb.r = p[2];
+            if(bytes == 4) {
+                alpha = p[3];
+                if(alpha != 0 && alphaRow < 0) {
+                    alphaRow = i;
+                    alphaCol = j;
+                }
+            }
+            if(preview != NULL) {
+                pixel = (uint32_t)p[2] << 16 | (uint32_t)p[1] << 8 | p[0] | (uint32_t)(bytes == 4 ? alpha:0) << 24;
+                preview[(size_t)(grid->height - 1 - y) * grid->width + j] = pixel;
+            }
+            if(alphaRow >= 0 && alpha < ALPHA_CUTOFF)
+                GRID(grid, y, j) = GRID_EMPTY;
+            else {
+                if(lastColor < 0 || rgb.r != last.r || rgb.g != last.g || rgb.b != last.b) {
+                    lastColor = match(rgb, key, n);
+                    last = rgb;
+                }
+                GRID(grid, y, j) = lastColor;
+            }
+        }
+    }
+    reportProgress(JOB_QUANTIZE, height, height);
+    free(row);
+
+    if(alphaRow >= 0) { /* The alpha byte is used, so the pixels read before it are transparent. */
+        for(i = 0 ; i <= alphaRow ; i++) {
+            y = h->height < 0 ? i:height - 1 - i;
+            if(y < grid->height)
+                memset(&GRID(grid, y, 0), GRID_EMPTY, i < alphaRow ? across:alphaCol);
+        }
+    }
+    else if(preview != NULL) /* No transparency data, or every alpha is 0 which means the alpha byte is not used. */
+        for(i = 0 ; i < grid->width * grid->height ; i++)
+            preview[i] |= PIXEL_OPAQUE;
+    return 1;
+}
+
+void quantizeImage(FILE *fr, FILE *colorKey, struct Grid *grid, uint32_t *pixels) {
+    /* Matches every pixel of the bmp to a color in the key. 'pixels' gets the image too, unless it is NULL. */
+    int n = amountOfColors(colorKey);
+    struct RGBColor *key = getKeyColors(colorKey, n);
+    struct BMPHeader h = readBMPHeader(fr);
+
+    decodeQuantize(fr, &h, key, n, grid, pixels);
+    free(key);
+}
@@ -0,0 +1,61 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: palette.h
+
+Timeline:
+20261019 - File created. Transfered functions over from main file.
+20261019 - Added in memory matching and frame reuse.
+20261019 - Uses the new contiguous grid.
+20261019 - Added nearestColorIndex.
+20261019 - Added ALPHA_CUTOFF for the alpha mask.
+20261019 - Added the built in palettes generated by genPalettes.c, keyMatcher and loadColorKey.
+20261019 - Added decodeQuantize.
+20261019 - Added colorKeyFits.
+20261019 - Added BUILTIN_PREFIX.
+*/
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "bmp.h"
+#include "grid.h"
+
+#define BUILTIN_PREFIX "builtin:" /* A color key path like "builtin:wool" loads a built in palette instead of a file. */
+#define ALPHA_CUTOFF 128 /* Pixels less opaque than this are masked out and become GRID_EMPTY. */
+
+typedef int (*ColorMatcher)(struct RGBColor compare, struct RGBColor *key, int n);
+
+struct BuiltinPalette { /* A bundled color key compiled in by genPalettes.c. */
+    char *file; /* Name of the csv it was made from. */
+    int colors;
+    char **names;
+    struct RGBColor *key;
+    uint32_t *pixelKey;
+    ColorMatcher match; /* Gives the same color as matchColorIndex. */
+};
+
+extern struct BuiltinPalette builtinPalettes[];
+extern int builtinPaletteCount;
+
+int getDiff(struct RGBColor c1, struct RGBColor c2);
+int selectColorIndex(struct RGBColor compare, FILE *colorKey);
+int amountOfColors(FILE *colorKey);
+int colorKeyFits(FILE *colorKey, char *path);
+char** getColorNames(FILE *colorKey, int n);
+void freeColorNames(char **colors);
+uint32_t* getPixelKey(FILE *colorKey, int n);
+struct RGBColor* getKeyColors(FILE *colorKey, int n);
+int nearestColorIndex(struct RGBColor compare, struct RGBColor *key, int n, int *diff);
+int matchColorIndex(struct RGBColor compare, struct RGBColor *key, int n);
+struct BuiltinPalette* findBuiltinPalette(char *name);
+ColorMatcher keyMatcher(struct RGBColor *key, int n);
+int loadColorKey(char *path, char ***names, struct RGBColor **key, uint32_t **pixelKey);
+void readPixels(FILE *fr, uint32_t *pixels);
+int quantizePixels(uint32_t *pixels, struct RGBColor *key, int n, struct Grid *grid, uint32_t *previousPixels, struct Grid *previousGrid);
+int decodeQuantize(FILE *fr, struct BMPHeader *h, struct RGBColor *key, int n, struct Grid *grid, uint32_t *preview);
+void quantizeImage(FILE *fr, FILE *colorKey, struct Grid *grid, uint32_t *pixels);
+
+#endif
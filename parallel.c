@@ -0,0 +1,170 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: parallel.c
+
+Note: Small helper to spread independent jobs across the cores of the machine.
+Each worker thread keeps grabbing the next job number until every job has been handed out.
+The worker threads are started by the first parallelFor that spreads and then wait for the next one, so a program that calls
+it thousands of times, like the daemon, does not pay for starting threads every time. The calling thread works alongside them.
+Only one parallelFor spreads across threads at a time. Any other call made while it runs, from inside one of its jobs or from another thread,
+runs its jobs on the calling thread, so jobs that are parallel inside can be run in parallel without making threads of threads.
+The worker threads take on the caller's current job from job.c, so cancelling it reaches them too.
+stopPool ends the worker threads, for a library that is about to be unloaded. The next parallelFor that spreads starts them again.
+
+Timeline:
+20261019 - File created.
+20261019 - Calls made while another parallelFor is spreading run inline.
+20261019 - Worker threads run under the caller's current job.
+20261019 - The workers actually install that job, they only stored it before.
+20261019 - The worker threads are started once and kept in a pool.
+20261019 - Added stopPool, the pool's threads can be ended before the code they run is unloaded.
+*/
+
+#include <windows.h>
+#include <stdlib.h>
+#include "parallel.h"
+#include "job.h"
+
+#define MAX_THREADS 64
+
+volatile LONG spreading = 0; /* Set while a parallelFor has threads running. */
+
+struct ParallelJobs {
+    void (*work)(void *context, int job);
+    void *context;
+    struct Job *owner; /* The caller's current job. */
+    int jobs;
+    volatile LONG next; /* The next job to hand out. */
+};
+
+DWORD WINAPI parallelWorker(LPVOID param) {
+    struct ParallelJobs *p = param;
+    struct Job *previous = beginJob(p->owner);
+    int job;
+
+    while((job = InterlockedIncrement(&p->next) - 1) < p->jobs)
+        p->work(p->context, job);
+
+    endJob(previous);
+    return 0;
+}
+
+struct ParallelPool {
+    CRITICAL_SECTION lock;
+    CONDITION_VARIABLE work;
+    CONDITION_VARIABLE finished;
+    struct ParallelJobs *jobs; /* What the workers are on, NULL between calls. */
+    LONG round; /* How many parallelFor calls were handed to the pool. */
+    int threads; /* 0 until the pool is started. */
+    int running; /* Workers still on the current round. */
+    int stopping; /* Set by stopPool, the workers return instead of taking the next round. */
+    HANDLE handles[MAX_THREADS];
+};
+
+struct ParallelPool pool; /* Only touched by the parallelFor holding 'spreading' and by its workers. */
+
+DWORD WINAPI poolWorker(LPVOID param) {
+    struct ParallelJobs *p;
+    LONG seen = 0;
+
+    EnterCriticalSection(&pool.lock);
+    while(1) {
+        while(pool.round == seen)
+            SleepConditionVariableCS(&pool.work, &pool.lock, INFINITE);
+        if(pool.stopping)
+            break;
+        seen = pool.round;
+        p = pool.jobs;
+        LeaveCriticalSection(&pool.lock);
+
+        parallelWorker(p);
+
+        EnterCriticalSection(&pool.lock);
+        if(--pool.running == 0)
+            WakeConditionVariable(&pool.finished);
+    }
+    LeaveCriticalSection(&pool.lock);
+    return 0;
+}
+
+void startPool(int threads) {
+    int i;
+    InitializeCriticalSection(&pool.lock);
+    InitializeConditionVariable(&pool.work);
+    InitializeConditionVariable(&pool.finished);
+    for(i = 0 ; i < threads ; i++)
+        pool.handles[i] = CreateThread(NULL, 0, poolWorker, NULL, 0, NULL);
+    pool.threads = threads;
+}
+
+void stopPool() { /* Waits for a parallelFor that is spreading to finish, then ends the worker threads. */
+    int i;
+
+    while(InterlockedCompareExchange(&spreading, 1, 0) != 0)
+        Sleep(1);
+    if(pool.threads > 0) {
+        EnterCriticalSection(&pool.lock);
+        pool.stopping = 1;
+        pool.round++;
+        WakeAllConditionVariable(&pool.work);
+        LeaveCriticalSection(&pool.lock);
+        WaitForMultipleObjects(pool.threads, pool.handles, TRUE, INFINITE);
+        for(i = 0 ; i < pool.threads ; i++)
+            CloseHandle(pool.handles[i]);
+        DeleteCriticalSection(&pool.lock);
+        pool.threads = 0;
+        pool.stopping = 0;
+        pool.round = 0; /* Workers started again begin from round 0. */
+    }
+    InterlockedExchange(&spreading, 0);
+}
+
+int parallelThreads() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+
+    if(info.dwNumberOfProcessors < 1)
+        return 1;
+    if(info.dwNumberOfProcessors > MAX_THREADS)
+        return MAX_THREADS;
+    return info.dwNumberOfProcessors;
+}
+
+void parallelFor(int jobs, void (*work)(void *context, int job), void *context) {
+    int threads = parallelThreads();
+    struct ParallelJobs p;
+
+    p.work = work;
+    p.context = context;
+    p.owner = currentJob();
+    p.jobs = jobs;
+    p.next = 0;
+
+    if(threads > jobs)
+        threads = jobs;
+
+    if(threads <= 1 || InterlockedCompareExchange(&spreading, 1, 0) != 0) { /* Not worth waking a thread for a single job, and the cores are already busy with another parallelFor. */
+        parallelWorker(&p);
+        return;
+    }
+
+    if(pool.threads == 0)
+        startPool(parallelThreads() - 1); /* The calling thread is the last worker. */
+
+    EnterCriticalSection(&pool.lock);
+    pool.jobs = &p;
+    pool.running = pool.threads;
+    pool.round++;
+    WakeAllConditionVariable(&pool.work);
+    LeaveCriticalSection(&pool.lock);
+
+    parallelWorker(&p);
+
+    EnterCriticalSection(&pool.lock); /* Every worker has to be done with 'p' before it goes out of scope. */
+    while(pool.running > 0)
+        SleepConditionVariableCS(&pool.finished, &pool.lock, INFINITE);
+    pool.jobs = NULL;
+    LeaveCriticalSection(&pool.lock);
+    InterlockedExchange(&spreading, 0);
+}
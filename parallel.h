@@ -0,0 +1,18 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: parallel.h
+
+Timeline:
+20261019 - File created.
+20261019 - Added stopPool.
+*/
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+int parallelThreads();
+void parallelFor(int jobs, void (*work)(void *context, int job), void *context);
+void stopPool();
+
+#endif
@@ -0,0 +1,248 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: progressive.c
+
+Note: The map fills in as the commands are placed, and a plan made color by color looks wrong until the very end.
+A progressive plan is made of layers. The first layer is the quad optimized at a coarse level of detail, which paints the whole map
+in a handful of commands. Each layer after it is a delta from what is already placed to the quad at a finer level of detail,
+so it only overdraws the pixels the coarser layer got wrong. The last layer is always the level of detail asked for, so the
+finished map is the same as the plain plan's.
+Which levels become layers is searched: every set of coarser levels is tried on its own thread. A plan is scored by its accuracy
+averaged over every command, which rewards getting close early. The best plan that uses no more than PROGRESSIVE_OVERHEAD percent
+more commands than the plain plan wins. The plain plan is one of the sets tried, so there is always one within the bound.
+
+Timeline:
+20261019 - File created.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "progressive.h"
+#include "commands.h"
+#include "delta.h"
+#include "palette.h"
+#include "parallel.h"
+
+struct ProgressiveSearch {
+    struct Quad *q;
+    struct Grid *grid;
+    struct Grid **levels; /* levels[k] is the quad imprinted at detail << k. */
+    int count; /* Levels of detail from 'detail' up to the size of the quad. */
+    int colors;
+    int detail;
+    int *commands; /* commands[layers] and scores[layers] for every set of layers. */
+    double *scores;
+};
+
+void layeredPlan(struct ProgressiveSearch *s, int layers, struct LinkedList *plan, int *layerCommands) {
+    /* Bit k of 'layers' makes level k a layer. Level 0 is always the last layer. layerCommands[k] gets the commands of each layer. */
+    struct Grid *placed = allocGrid(s->grid->width, s->grid->height);
+    int k, first = 1, before;
+
+    for(k = s->count - 1 ; k >= 0 ; k--) {
+        if(k > 0 && !(layers & (1 << k)))
+            continue;
+        before = queueLength(plan);
+        if(first) {
+            quad(s->q, plan, NULL, s->detail << k, 0);
+            optimizeCommands(plan, s->colors, s->detail << k);
+            first = 0;
+        }
+        else {
+            imprintGrid(plan, placed); /* What is really on the map, fills of the first layer may have run over masked pixels. */
+            deltaCommands(placed, s->levels[k], plan);
+        }
+        if(layerCommands != NULL)
+            layerCommands[k] = queueLength(plan) - before;
+    }
+
+    freeGrid(placed);
+}
+
+int regionCorrect(struct Grid *placed, struct Grid *grid, int startRow, int startCol, int endRow, int endCol) {
+    int i, j, count = 0;
+    for(i = startRow ; i <= endRow ; i++)
+        for(j = startCol ; j <= endCol ; j++)
+            if(GRID(grid, i, j) != GRID_EMPTY && GRID(placed, i, j) == GRID(grid, i, j))
+                count++;
+    return count;
+}
+
+void accuracyCurve(struct LinkedList *plan, struct Grid *grid, int *correct) {
+    /* correct[i] is how many pixels of the grid are right once the first i + 1 commands are placed. */
+    struct Grid *placed = allocGrid(grid->width, grid->height);
+    struct Node *n;
+    int i = 0, right = 0;
+
+    clearGrid(placed);
+    for(n = plan->head ; n != NULL ; n = n->next) {
+        struct Marker *m = n->marker;
+        int startRow = m->clone ? m->destRow:m->startRow, startCol = m->clone ? m->destCol:m->startCol;
+        int endRow = startRow + m->endRow - m->startRow, endCol = startCol + m->endCol - m->startCol;
+
+        right -= regionCorrect(placed, grid, startRow, startCol, endRow, endCol);
+        if(m->clone)
+            copyRegion(placed, m);
+        else
+            fillGrid(placed, m->startRow, m->startCol, m->endRow, m->endCol, m->colorKey);
+        right += regionCorrect(placed, grid, startRow, startCol, endRow, endCol);
+        correct[i++] = right;
+    }
+
+    freeGrid(placed);
+}
+
+void scoreLayers(void *context, int layers) {
+    struct ProgressiveSearch *s = context;
+    struct LinkedList plan = {NULL, NULL};
+    int i, n, *correct;
+    double sum = 0;
+
+    if(layers & 1) { /* Level 0 is always a layer, so odd sets are the same as the even set below them. */
+        s->commands[layers] = -1;
+        return;
+    }
+
+    layeredPlan(s, layers, &plan, NULL);
+    n = queueLength(&plan);
+    correct = malloc((n > 0 ? n:1) * sizeof(int));
+    accuracyCurve(&plan, s->grid, correct);
+    for(i = 0 ; i < n ; i++)
+        sum += correct[i];
+
+    s->commands[layers] = n;
+    s->scores[layers] = n > 0 ? sum / n:0;
+    free(correct);
+    freeQueue(&plan);
+}
+
+int progressiveCommands(struct Quad *q, struct Grid *grid, int colors, int detail, struct LinkedList *plan, int *layerCommands) {
+    /* Appends the best progressive plan to 'plan' and returns its layers, bit k set for detail << k. */
+    struct ProgressiveSearch s;
+    struct LinkedList levelPlan = {NULL, NULL};
+    int k, sets, best = 0;
+
+    s.q = q;
+    s.grid = grid;
+    s.colors = colors;
+    s.detail = detail;
+    for(s.count = 0 ; (detail << s.count) <= q->size ; s.count++);
+    s.levels = malloc(s.count * sizeof(struct Grid*));
+    for(k = 0 ; k < s.count ; k++) {
+        s.levels[k] = allocGrid(grid->width, grid->height);
+        quad(q, &levelPlan, NULL, detail << k, 0);
+        imprintGrid(&levelPlan, s.levels[k]);
+        freeQueue(&levelPlan);
+    }
+
+    sets = 1 << s.count;
+    s.commands = malloc(sets * sizeof(int));
+    s.scores = malloc(sets * sizeof(double));
+    parallelFor(sets, scoreLayers, &s);
+
+    for(k = 2 ; k < sets ; k += 2) /* Set 0 is the plain plan. */
+        if((long)s.commands[k] * 100 <= (long)s.commands[0] * (100 + PROGRESSIVE_OVERHEAD) && s.scores[k] > s.scores[best])
+            best = k;
+    layeredPlan(&s, best, plan, layerCommands);
+
+    for(k = 0 ; k < s.count ; k++)
+        freeGrid(s.levels[k]);
+    free(s.levels);
+    free(s.commands);
+    free(s.scores);
+    return best;
+}
+
+int commandsToReach(int *correct, int n, int target) { /* How many commands it takes before 'target' pixels are right. */
+    int i;
+    for(i = 0 ; i < n ; i++)
+        if(correct[i] >= target)
+            return i + 1;
+    return n;
+}
+
+void progressiveMode(char *image, char *key, int detail) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r");
+    struct LinkedList plan = {NULL, NULL}, plain = {NULL, NULL};
+    struct Quad q;
+    struct Grid *grid, *finished, *expected;
+    char **colors;
+    uint32_t *pixelKey;
+    int i, k, n, layers, total, commands, plainCommands, *layerCommands, *correct, *plainCorrect;
+    int checkpoints[] = {1, 2, 5, 10, 25, 50, 75, 100};
+
+    if(fr == NULL || colorKey == NULL) {
+        printf("Progressive mode could not open %s or %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    grid = allocGrid(128, 128);
+    finished = allocGrid(128, 128);
+    expected = allocGrid(128, 128);
+    layerCommands = calloc(8, sizeof(int)); /* One for every level of detail from 1 to 128. */
+
+    quantizeImage(fr, colorKey, grid, NULL);
+    q = buildQuadExact(grid, n, 128);
+    quad(&q, &plain, NULL, detail, 0);
+    imprintGrid(&plain, expected);
+    optimizeCommands(&plain, n, detail);
+    layers = progressiveCommands(&q, grid, n, detail, &plan, layerCommands);
+
+    imprintGrid(&plan, finished);
+    if(!gridsMatch(expected, finished))
+        printf("ERROR: The progressive plan does not finish on the same map as the plain plan.\n");
+
+    commands = queueLength(&plan);
+    plainCommands = queueLength(&plain);
+    printf("Progressive: %i commands, plain: %i commands (%+.1f%%).\n", commands, plainCommands, plainCommands > 0 ? 100.0 * (commands - plainCommands) / plainCommands:0);
+    for(k = 0 ; (detail << (k + 1)) <= 128 ; k++);
+    for( ; k >= 0 ; k--)
+        if(k == 0 || (layers & (1 << k)))
+            printf("Layer at detail %i: %i commands\n", detail << k, layerCommands[k]);
+
+    correct = malloc((commands > 0 ? commands:1) * sizeof(int));
+    plainCorrect = malloc((plainCommands > 0 ? plainCommands:1) * sizeof(int));
+    accuracyCurve(&plan, grid, correct);
+    accuracyCurve(&plain, grid, plainCorrect);
+    total = regionCorrect(grid, grid, 0, 0, 127, 127); /* Every pixel that is not masked. */
+
+    printf("Commands placed | progressive accuracy | plain accuracy\n");
+    for(i = 0 ; i < (int)(sizeof(checkpoints) / sizeof(int)) && commands > 0 && plainCommands > 0 && total > 0 ; i++) {
+        int p = (commands * checkpoints[i] + 99) / 100, pp = (plainCommands * checkpoints[i] + 99) / 100;
+        printf("%3i%% | %5.1f%% after %i | %5.1f%% after %i\n", checkpoints[i], 100.0 * correct[p - 1] / total, p, 100.0 * plainCorrect[pp - 1] / total, pp);
+    }
+    if(commands > 0 && plainCommands > 0)
+        printf("90%% of the final accuracy after %i commands progressive, %i plain.\n",
+            commandsToReach(correct, commands, correct[commands - 1] * 9 / 10), commandsToReach(plainCorrect, plainCommands, plainCorrect[plainCommands - 1] * 9 / 10));
+
+    writeCommands(&plan, colors, pixelKey);
+    freeQueue(&plain);
+    destroyQuad(&q);
+    freeGrid(grid);
+    freeGrid(finished);
+    freeGrid(expected);
+    freeColorNames(colors);
+    free(layerCommands);
+    free(correct);
+    free(plainCorrect);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+}
@@ -0,0 +1,23 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: progressive.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "linkedList.h"
+#include "quad.h"
+#include "grid.h"
+
+#define PROGRESSIVE_OVERHEAD 25 /* Percent more commands than the plain plan a progressive plan may use. */
+
+int progressiveCommands(struct Quad *q, struct Grid *grid, int colors, int detail, struct LinkedList *plan, int *layerCommands);
+void accuracyCurve(struct LinkedList *plan, struct Grid *grid, int *correct);
+void progressiveMode(char *image, char *key, int detail);
+
+#endif
@@ -6,19 +6,27 @@ File: quad.c
 Timeline:
 20240921 - File  created
 20240923 - Quad now properly zero's out 'counts' array before using it.
+20261019 - Added buildQuadExact. The color of each quad is the true majority of its whole region.
+Region counts are merged from the bottom up into one block of memory instead of a counts array per quad.
+20261019 - Quads are built from the new contiguous grid.
+20261019 - GRID_EMPTY pixels are left out of the counts. A region with nothing but GRID_EMPTY pixels gets GRID_EMPTY as its color.
+20261019 - buildQuadExact stores the error of every quad, taken from the same counts as its majority.
+20261019 - buildQuadExact stops splitting once the current job is cancelled. The quad it leaves can still be destroyed.
+20261019 - Added buildQuadCounted for callers that keep the counts to update them later.
 */
 
 #include "quad.h"
 #include "stdio.h"
+#include "job.h"
 
-int buildQuadHelperOG(struct Quad *q, int **grid, int row, int col, int size) {
+int buildQuadHelperOG(struct Quad *q, struct Grid *grid, int row, int col, int size) {
     int i, childSize = size/2, colors[4], counts[4], dominantCount = 0;
     q->row = row;
     q->col = col;
     q->size = size;
 
     if(size == 1) { /* When you can't go deeper, return. */
-        q->color = grid[row][col];
+        q->color = GRID(grid, row, col);
         for(i = 0 ; i < 4 ; i++)
             q->children[i] == NULL;
         q->leaf = 1;
@@ -52,14 +60,14 @@ int buildQuadHelperOG(struct Quad *q, int **grid, int row, int col, int size) {
     return q->color;
 }
 
-void buildQuadHelper(struct Quad *q, int **grid, int *parentCounts, int colors, int row, int col, int size) {
+void buildQuadHelper(struct Quad *q, struct Grid *grid, int *parentCounts, int colors, int row, int col, int size) {
     int i, childSize = size/2, *counts;
     q->row = row;
     q->col = col;
     q->size = size;
 
     if(size == 1) { /* When you can't go deeper, return. */
-        q->color = grid[row][col];
+        q->color = GRID(grid, row, col);
         q->leaf = 1;
         parentCounts[q->color]++;
         printf("Root Quad Color: %i\n", q->color);
@@ -96,13 +104,142 @@ void buildQuadHelper(struct Quad *q, int **grid, int *parentCounts, int colors,
     free(counts);
 }
 
-struct Quad buildQuadOG(int **grid, int size) {
+struct QuadCounts* allocQuadCounts(struct Grid *grid, int colors, int size) {
+    struct QuadCounts *qc = malloc(sizeof(struct QuadCounts));
+    int i, j, k, level, width, total = 0;
+    int *block;
+
+    qc->colors = colors;
+    qc->size = size;
+    qc->levels = 0;
+    for(width = size/2 ; width >= 1 ; width /= 2) { /* Figuring out how much room every level needs. */
+        total += width * width * colors;
+        qc->levels++;
+    }
+
+    qc->counts = malloc((qc->levels > 0 ? qc->levels:1) * sizeof(int*));
+    block = calloc(total > 0 ? total:1, sizeof(int));
+
+    width = size/2;
+    for(level = 0 ; level < qc->levels ; level++) {
+        qc->counts[level] = block;
+        block += width * width * colors;
+        width /= 2;
+    }
+
+    if(qc->levels == 0)
+        return qc;
+
+    width = size/2;
+    for(i = 0 ; i < width ; i++) /* The 2x2 regions are counted straight from the grid. */
+        for(j = 0 ; j < width ; j++) {
+            int *counts = qc->counts[0] + (i * width + j) * colors;
+            uint8_t cells[4];
+            cells[0] = GRID(grid, 2 * i, 2 * j);
+            cells[1] = GRID(grid, 2 * i, 2 * j + 1);
+            cells[2] = GRID(grid, 2 * i + 1, 2 * j);
+            cells[3] = GRID(grid, 2 * i + 1, 2 * j + 1);
+            for(k = 0 ; k < 4 ; k++)
+                if(cells[k] != GRID_EMPTY)
+                    counts[cells[k]]++;
+        }
+
+    for(level = 1 ; level < qc->levels ; level++) { /* Every other region adds up the counts of its four children. */
+        int childWidth = width;
+        width /= 2;
+        for(i = 0 ; i < width ; i++)
+            for(j = 0 ; j < width ; j++) {
+                int *counts = qc->counts[level] + (i * width + j) * colors;
+                int *c0 = qc->counts[level - 1] + ((2 * i) * childWidth + 2 * j) * colors;
+                int *c1 = c0 + colors, *c2 = c0 + childWidth * colors, *c3 = c2 + colors;
+                for(k = 0 ; k < colors ; k++)
+                    counts[k] = c0[k] + c1[k] + c2[k] + c3[k];
+            }
+    }
+
+    return qc;
+}
+
+int* regionCounts(struct QuadCounts *qc, int row, int col, int size) {
+    int level = 0, width = qc->size/size;
+    while((2 << level) < size)
+        level++;
+    return qc->counts[level] + ((row/size) * width + col/size) * qc->colors;
+}
+
+int majorityColor(struct QuadCounts *qc, int row, int col, int size) {
+    int i, color = 0, *counts = regionCounts(qc, row, col, size);
+    for(i = 1 ; i < qc->colors ; i++) /* Ties go to the lower index, same as buildQuadHelper. */
+        if(counts[i] > counts[color])
+            color = i;
+    return counts[color] > 0 ? color:GRID_EMPTY;
+}
+
+int regionError(struct QuadCounts *qc, int row, int col, int size, int color) { /* Pixels of the region that are neither 'color' nor GRID_EMPTY. */
+    int i, error = 0, *counts = regionCounts(qc, row, col, size);
+    for(i = 0 ; i < qc->colors ; i++)
+        if(i != color)
+            error += counts[i];
+    return error;
+}
+
+void freeQuadCounts(struct QuadCounts *qc) {
+    free(qc->counts[0]);
+    free(qc->counts);
+    free(qc);
+}
+
+void buildQuadHelperExact(struct Quad *q, struct Grid *grid, struct QuadCounts *qc, int row, int col, int size) {
+    int i, childSize = size/2;
+    q->row = row;
+    q->col = col;
+    q->size = size;
+
+    if(size == 1) { /* When you can't go deeper, return. */
+        q->color = GRID(grid, row, col);
+        q->error = 0;
+        q->leaf = 1;
+        return;
+    }
+    q->color = majorityColor(qc, row, col, size);
+    q->error = regionError(qc, row, col, size, q->color);
+    if(size >= 16 && jobCancelled()) { /* Nobody wants the quad anymore, so it is cut off here. */
+        q->leaf = 1;
+        return;
+    }
+    q->leaf = 0;
+
+    for(i = 0 ; i < 4 ; i++)
+        q->children[i] = malloc(sizeof(struct Quad));
+
+    buildQuadHelperExact(q->children[0], grid, qc, row, col, childSize);
+    buildQuadHelperExact(q->children[1], grid, qc, row, col + childSize, childSize);
+    buildQuadHelperExact(q->children[2], grid, qc, row + childSize, col, childSize);
+    buildQuadHelperExact(q->children[3], grid, qc, row + childSize, col + childSize, childSize);
+}
+
+struct Quad buildQuadCounted(struct Grid *grid, struct QuadCounts *qc) { /* buildQuadExact with counts the caller made and still owns. */
+    struct Quad quad;
+    reportProgress(JOB_QUAD, 0, 1);
+    buildQuadHelperExact(&quad, grid, qc, 0, 0, qc->size);
+    reportProgress(JOB_QUAD, 1, 1);
+    return quad;
+}
+
+struct Quad buildQuadExact(struct Grid *grid, int colors, int size) {
+    struct QuadCounts *qc = allocQuadCounts(grid, colors, size);
+    struct Quad quad = buildQuadCounted(grid, qc);
+    freeQuadCounts(qc);
+    return quad;
+}
+
+struct Quad buildQuadOG(struct Grid *grid, int size) {
     struct Quad quad;
     buildQuadHelperOG(&quad, grid, 0, 0, size);
     return quad;
 }
 
-struct Quad buildQuad(int **grid, int colors, int size) {
+struct Quad buildQuad(struct Grid *grid, int colors, int size) {
     int * counts = malloc(colors * sizeof(int));
     struct Quad quad;
     buildQuadHelper(&quad, grid, counts, colors, 0, 0, size);
@@ -5,9 +5,18 @@ File: quad.h
 
 Timeline:
 20240921 - File  created
+20261019 - Added include guard since the header is now included by more than one file.
+20261019 - Added QuadCounts and buildQuadExact.
+20261019 - Quads are built from the new contiguous grid.
+20261019 - Quads keep their error. Added regionError.
+20261019 - Added buildQuadCounted.
 */
 
+#ifndef QUAD_H
+#define QUAD_H
+
 #include <stdlib.h>
+#include "grid.h"
 
 struct Quad {
     struct Quad *children[4];
@@ -16,8 +25,25 @@ struct Quad {
     int leaf;
     int row;
     int col;
+    int error; /* Pixels in the region that are not its color, what painting the whole region one color gets wrong. Set by buildQuadExact. */
 };
 
-struct Quad buildQuad(int **grid, int colors, int size);
-struct Quad buildQuadOG(int **grid, int size);
-void destroyQuad(struct Quad *q);
\ No newline at end of file
+struct QuadCounts { /* Color counts of every region a quad can cover, merged from the bottom up. */
+    int colors;
+    int size;
+    int levels; /* Level 0 holds the 2x2 regions, level 1 the 4x4 regions and so on. */
+    int **counts; /* counts[level][(row * width + col) * colors + color] where width is the amount of regions across. */
+};
+
+struct Quad buildQuad(struct Grid *grid, int colors, int size);
+struct Quad buildQuadExact(struct Grid *grid, int colors, int size);
+struct Quad buildQuadCounted(struct Grid *grid, struct QuadCounts *qc);
+struct QuadCounts* allocQuadCounts(struct Grid *grid, int colors, int size);
+int* regionCounts(struct QuadCounts *qc, int row, int col, int size);
+int majorityColor(struct QuadCounts *qc, int row, int col, int size);
+int regionError(struct QuadCounts *qc, int row, int col, int size, int color);
+void freeQuadCounts(struct QuadCounts *qc);
+struct Quad buildQuadOG(struct Grid *grid, int size);
+void destroyQuad(struct Quad *q);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,326 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: reduce.c
+
+Note: A big color key gives many small islands of color and so many commands. Most images look nearly as good with a handful of blocks.
+Reduce mode picks the k blocks of a key that keep the quantization error lowest, for every k up to the blocks the image uses.
+The image is boiled down to a histogram of its distinct colors first, so everything after works on a few thousand colors
+rather than every pixel. The distance from every distinct color to every block is worked out once, in parallel.
+The picking is k-medoids where the medoids can only be blocks of the key. Blocks are first added greedily, each time the one that
+lowers the error the most. Then for each k, swapping a picked block for one that was not picked is tried for every pair, and the
+best swap is kept until no swap helps. Each swap is scored in one pass over the histogram using every color's nearest and second
+nearest picked block. Every k is picked, quantized and planned on its own thread, so the report shows commands against error for all of them.
+The blocks picked keep the order they have in the key, so ties are broken the same way as with the full key.
+
+Timeline:
+20261019 - File created.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "reduce.h"
+#include "commands.h"
+#include "palette.h"
+#include "parallel.h"
+
+struct Reduction {
+    int unique; /* Distinct opaque colors in the image. */
+    int opaque; /* Pixels that are not masked. */
+    struct RGBColor *colors;
+    int *counts; /* Pixels of each distinct color. */
+    int n; /* Blocks in the key. */
+    struct RGBColor *key;
+    int *distances; /* distances[color * n + block] */
+    int *built; /* Blocks in the order the greedy pass added them. */
+    uint32_t *pixels;
+    int detail;
+    int *picked; /* picked[k * n + block] is set when the block is one of the k picked. */
+    long *errors; /* errors[k] is the summed distance of every pixel to its nearest picked block. */
+    int *commands;
+};
+
+int compareColors(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return x < y ? -1:x > y;
+}
+
+void buildHistogram(struct Reduction *r, uint32_t *pixels) {
+    uint32_t *sorted = malloc(128 * 128 * sizeof(uint32_t));
+    int i, n = 0;
+
+    for(i = 0 ; i < 128 * 128 ; i++)
+        if(PIXEL_ALPHA(pixels[i]) >= ALPHA_CUTOFF)
+            sorted[n++] = pixels[i] & 0x00FFFFFF;
+    qsort(sorted, n, sizeof(uint32_t), compareColors);
+
+    r->colors = malloc((n > 0 ? n:1) * sizeof(struct RGBColor));
+    r->counts = malloc((n > 0 ? n:1) * sizeof(int));
+    r->unique = 0;
+    r->opaque = n;
+    for(i = 0 ; i < n ; i++) {
+        if(i == 0 || sorted[i] != sorted[i - 1]) {
+            r->colors[r->unique] = pixelToRGB(sorted[i]);
+            r->counts[r->unique++] = 0;
+        }
+        r->counts[r->unique - 1]++;
+    }
+    free(sorted);
+}
+
+void histogramDistances(void *context, int job) { /* One job per REDUCE_CHUNK distinct colors. */
+    struct Reduction *r = context;
+    int u, p, last = (job + 1) * REDUCE_CHUNK;
+
+    if(last > r->unique)
+        last = r->unique;
+    for(u = job * REDUCE_CHUNK ; u < last ; u++)
+        for(p = 0 ; p < r->n ; p++)
+            r->distances[u * r->n + p] = getDiff(r->colors[u], r->key[p]);
+}
+
+long pickedError(struct Reduction *r, int *picked, int *nearest, int *second) {
+    /* Fills in the distance to the nearest and second nearest picked block of every color, returns the summed error. */
+    int u, p;
+    long error = 0;
+
+    for(u = 0 ; u < r->unique ; u++) {
+        int *d = r->distances + u * r->n;
+        nearest[u] = second[u] = __INT_MAX__;
+        for(p = 0 ; p < r->n ; p++) {
+            if(!picked[p])
+                continue;
+            if(d[p] < nearest[u]) {
+                second[u] = nearest[u];
+                nearest[u] = d[p];
+            }
+            else if(d[p] < second[u])
+                second[u] = d[p];
+        }
+        error += (long)r->counts[u] * nearest[u];
+    }
+    return error;
+}
+
+void greedyBuild(struct Reduction *r) { /* Adds blocks one at a time, each time the one that lowers the error the most. */
+    int i, u, p, best, *nearest = malloc(r->unique * sizeof(int)), *picked = calloc(r->n, sizeof(int));
+    long cost, bestCost;
+
+    for(u = 0 ; u < r->unique ; u++)
+        nearest[u] = __INT_MAX__;
+
+    for(i = 0 ; i < r->n ; i++) {
+        best = -1;
+        bestCost = 0;
+        for(p = 0 ; p < r->n ; p++) {
+            if(picked[p])
+                continue;
+            for(cost = 0, u = 0 ; u < r->unique ; u++) {
+                int d = r->distances[u * r->n + p];
+                cost += (long)r->counts[u] * (d < nearest[u] ? d:nearest[u]);
+            }
+            if(best < 0 || cost < bestCost) {
+                best = p;
+                bestCost = cost;
+            }
+        }
+        picked[best] = 1;
+        r->built[i] = best;
+        for(u = 0 ; u < r->unique ; u++)
+            if(r->distances[u * r->n + best] < nearest[u])
+                nearest[u] = r->distances[u * r->n + best];
+    }
+
+    free(nearest);
+    free(picked);
+}
+
+long swapBlocks(struct Reduction *r, int *picked) { /* Keeps making the best swap of a picked block for an unpicked one until none helps. */
+    int u, in, out, bestIn, bestOut, *nearest = malloc(r->unique * sizeof(int)), *second = malloc(r->unique * sizeof(int));
+    long error = pickedError(r, picked, nearest, second), change, bestChange;
+
+    do {
+        bestChange = 0;
+        bestIn = bestOut = -1;
+        for(out = 0 ; out < r->n ; out++) {
+            if(!picked[out])
+                continue;
+            for(in = 0 ; in < r->n ; in++) {
+                if(picked[in])
+                    continue;
+                for(change = 0, u = 0 ; u < r->unique ; u++) {
+                    int *d = r->distances + u * r->n, without = d[out] == nearest[u] ? second[u]:nearest[u]; /* Nearest once 'out' is gone. */
+                    change += (long)r->counts[u] * ((d[in] < without ? d[in]:without) - nearest[u]);
+                }
+                if(change < bestChange) {
+                    bestChange = change;
+                    bestIn = in;
+                    bestOut = out;
+                }
+            }
+        }
+        if(bestIn >= 0) {
+            picked[bestOut] = 0;
+            picked[bestIn] = 1;
+            error = pickedError(r, picked, nearest, second);
+        }
+    } while(bestIn >= 0);
+
+    free(nearest);
+    free(second);
+    return error;
+}
+
+int pickedKey(struct Reduction *r, int *picked, struct RGBColor *key, int *blocks) { /* The picked blocks in key order. Returns how many. */
+    int p, k = 0;
+    for(p = 0 ; p < r->n ; p++)
+        if(picked[p]) {
+            key[k] = r->key[p];
+            blocks[k++] = p;
+        }
+    return k;
+}
+
+int planCommands(uint32_t *pixels, struct RGBColor *key, int k, int detail, struct LinkedList *plan) { /* Quantizes to the key and plans it. Returns how many commands. */
+    struct Grid *grid = allocGrid(128, 128);
+    struct LinkedList queue = {NULL, NULL};
+    struct Quad q;
+    int commands;
+
+    quantizePixels(pixels, key, k, grid, NULL, NULL);
+    q = buildQuadExact(grid, k, 128);
+    quad(&q, &queue, NULL, detail, 0);
+    optimizeCommands(&queue, k, detail);
+    commands = queueLength(&queue);
+
+    if(plan != NULL)
+        *plan = queue;
+    else
+        freeQueue(&queue);
+    destroyQuad(&q);
+    freeGrid(grid);
+    return commands;
+}
+
+void reduceJob(void *context, int job) { /* Picks and plans k = job + 1 blocks. */
+    struct Reduction *r = context;
+    int i, k = job + 1, *picked = r->picked + k * r->n, *blocks = malloc(k * sizeof(int));
+    struct RGBColor *key = malloc(k * sizeof(struct RGBColor));
+
+    for(i = 0 ; i < k ; i++)
+        picked[r->built[i]] = 1;
+    r->errors[k] = swapBlocks(r, picked);
+    pickedKey(r, picked, key, blocks);
+    r->commands[k] = planCommands(r->pixels, key, k, r->detail, NULL);
+
+    free(blocks);
+    free(key);
+}
+
+void writeReducedKey(char *path, int *blocks, int k, struct RGBColor *key, char **names) {
+    FILE *csv = fopen(path, "w");
+    int i;
+    if(csv == NULL)
+        return;
+    for(i = 0 ; i < k ; i++)
+        fprintf(csv, "%i,%i,%i,%s\n", key[blocks[i]].r, key[blocks[i]].g, key[blocks[i]].b, names[blocks[i]]);
+    fclose(csv);
+}
+
+void reduceMode(char *image, char *keyPath, int detail, int k) {
+    FILE *fr = fopen(image, "rb");
+    struct Reduction r;
+    struct LinkedList plan = {NULL, NULL};
+    struct RGBColor *key, *reducedKey;
+    char **names, **reducedNames;
+    uint32_t *pixelKey, *reducedPixelKey;
+    int i, used, chunks, *blocks, *usedBlocks;
+    DWORD start = GetTickCount();
+
+    r.n = fr == NULL ? 0:loadColorKey(keyPath, &names, &key, &pixelKey);
+    if(r.n == 0) {
+        printf("Reduce mode could not open %s or %s.\n", image, keyPath);
+        if(fr != NULL)
+            fclose(fr);
+        return;
+    }
+
+    r.key = key;
+    r.detail = detail;
+    r.pixels = malloc(128 * 128 * sizeof(uint32_t));
+    readPixels(fr, r.pixels);
+    buildHistogram(&r, r.pixels);
+
+    r.distances = malloc(((size_t)r.unique * r.n > 0 ? (size_t)r.unique * r.n:1) * sizeof(int));
+    chunks = (r.unique + REDUCE_CHUNK - 1) / REDUCE_CHUNK;
+    parallelFor(chunks, histogramDistances, &r);
+
+    usedBlocks = calloc(r.n, sizeof(int)); /* Blocks past the ones the full key actually uses can not lower the error any further. */
+    for(i = 0 ; i < r.unique ; i++)
+        usedBlocks[nearestColorIndex(r.colors[i], r.key, r.n, NULL)] = 1;
+    for(used = 0, i = 0 ; i < r.n ; i++)
+        used += usedBlocks[i];
+
+    r.built = malloc(r.n * sizeof(int));
+    r.picked = calloc((size_t)(used + 1) * r.n, sizeof(int));
+    r.errors = calloc(used + 1, sizeof(long));
+    r.commands = calloc(used + 1, sizeof(int));
+    if(used > 0) {
+        greedyBuild(&r);
+        parallelFor(used, reduceJob, &r);
+    }
+
+    printf("Reduce: %i distinct colors, %i of %i blocks used by the full key, picked in %lu ms.\n", r.unique, used, r.n, (unsigned long)(GetTickCount() - start));
+    printf("Blocks | mean error per pixel | commands\n");
+    for(i = 1 ; i <= used ; i++)
+        printf("%6i | %20.2f | %i\n", i, (double)r.errors[i] / r.opaque, r.commands[i]);
+
+    if(k <= 0 || k > used) { /* Fewest blocks within REDUCE_ERROR_SLACK of the error with every block. */
+        for(k = 1 ; k < used && r.errors[k] > r.errors[used] + (long)REDUCE_ERROR_SLACK * r.opaque ; k++);
+        if(used == 0)
+            k = 0;
+    }
+
+    if(k > 0) {
+        reducedKey = malloc(k * sizeof(struct RGBColor));
+        blocks = malloc(k * sizeof(int));
+        pickedKey(&r, r.picked + k * r.n, reducedKey, blocks);
+        reducedNames = malloc((k + 1) * sizeof(char*));
+        reducedPixelKey = malloc(k * sizeof(uint32_t));
+        for(i = 0 ; i < k ; i++) {
+            reducedNames[i] = malloc(128 * sizeof(char));
+            strcpy(reducedNames[i], names[blocks[i]]);
+            reducedPixelKey[i] = pixelKey[blocks[i]];
+        }
+        reducedNames[k] = NULL;
+
+        printf("Picked %i blocks:", k);
+        for(i = 0 ; i < k ; i++)
+            printf(" %s", reducedNames[i]);
+        printf("\n");
+
+        planCommands(r.pixels, reducedKey, k, detail, &plan);
+        writeReducedKey(".\\reducedKey.csv", blocks, k, key, names);
+        writeCommands(&plan, reducedNames, reducedPixelKey);
+
+        freeColorNames(reducedNames);
+        free(reducedPixelKey);
+        free(reducedKey);
+        free(blocks);
+    }
+
+    free(usedBlocks);
+    free(r.colors);
+    free(r.counts);
+    free(r.distances);
+    free(r.built);
+    free(r.picked);
+    free(r.errors);
+    free(r.commands);
+    free(r.pixels);
+    freeColorNames(names);
+    free(key);
+    free(pixelKey);
+    fclose(fr);
+}
@@ -0,0 +1,18 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: reduce.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#define REDUCE_CHUNK 256 /* Distinct colors one job measures against every block. */
+#define REDUCE_ERROR_SLACK 12 /* How much more mean error per pixel than the full key is allowed when no amount of blocks is given. */
+
+void reduceMode(char *image, char *key, int detail, int k);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: requantize.c
+
+Note: Editing a color key used to mean matching every pixel against the whole key again.
+A quantization keeps how far every pixel is from the color it matched. When the key is edited, colors are lined up with the old key by block name.
+A pixel whose color is still in the key, with the same RGB, only needs comparing against the colors that are new or moved,
+since every other color in the key already lost to its color. Only pixels whose color was removed or moved are matched against the whole key.
+Ties still go to the earlier line, so the result is the same as matching from scratch.
+The quad is only recounted where a pixel changed blocks. Everywhere else the colors are just renumbered, which leaves every majority the same
+as long as the kept colors stay in the same order. If they do not, every quad is recounted.
+The plan written is a delta from the map made with the old key, so only the regions that changed get commands.
+
+Timeline:
+20261019 - File created.
+20261019 - Masked pixels stay GRID_EMPTY through every edit.
+20261019 - Recounted quads get their error updated too.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "requantize.h"
+#include "palette.h"
+#include "commands.h"
+#include "delta.h"
+
+struct Quantization* allocQuantization(uint32_t *pixels, struct RGBColor *key, char **names, int n) { /* Takes ownership of the key and names. */
+    struct Quantization *z = malloc(sizeof(struct Quantization));
+    int i, j;
+
+    z->colors = n;
+    z->key = key;
+    z->names = names;
+    z->pixels = pixels;
+    z->grid = allocGrid(128, 128);
+    z->distances = malloc(128 * 128 * sizeof(int));
+    z->reordered = 0;
+    z->rematched = 128 * 128;
+    z->checked = 0;
+
+    for(i = 0 ; i < 128 ; i++)
+        for(j = 0 ; j < 128 ; j++) {
+            uint32_t pixel = pixels[(127 - i) * 128 + j];
+            z->distances[i * 128 + j] = 0;
+            if(PIXEL_ALPHA(pixel) < ALPHA_CUTOFF)
+                GRID(z->grid, i, j) = GRID_EMPTY;
+            else
+                GRID(z->grid, i, j) = nearestColorIndex(pixelToRGB(pixel), key, n, &z->distances[i * 128 + j]);
+        }
+
+    return z;
+}
+
+void freeQuantization(struct Quantization *z) {
+    freeGrid(z->grid);
+    free(z->distances);
+    free(z->key);
+    freeColorNames(z->names);
+    free(z);
+}
+
+/*
+Swaps in an edited key and fixes up the grid. 'map' gets the new index of every old color, or -1 if it was removed.
+'changed' is set for every pixel that ended up with a different block. Returns how many pixels changed.
+*/
+int requantize(struct Quantization *z, struct RGBColor *key, char **names, int n, int *map, uint8_t *changed) {
+    int i, j, k, fresh = 0, changes = 0, last = -1;
+    int *freshColors = malloc(n * sizeof(int));
+    uint8_t *moved = calloc(z->colors, 1), *kept = calloc(n, 1);
+
+    z->reordered = 0;
+    for(i = 0 ; i < z->colors ; i++) {
+        map[i] = -1;
+        for(j = 0 ; j < n && map[i] == -1 ; j++)
+            if(!kept[j] && strcmp(z->names[i], names[j]) == 0) {
+                map[i] = j;
+                kept[j] = 1;
+            }
+        if(map[i] == -1)
+            continue;
+        moved[i] = getDiff(z->key[i], key[map[i]]) != 0;
+        if(moved[i])
+            freshColors[fresh++] = map[i];
+        if(map[i] < last)
+            z->reordered = 1;
+        last = map[i];
+    }
+    for(j = 0 ; j < n ; j++)
+        if(!kept[j])
+            freshColors[fresh++] = j;
+
+    z->rematched = 0;
+    z->checked = 0;
+    for(i = 0 ; i < 128 ; i++)
+        for(j = 0 ; j < 128 ; j++) {
+            int p = i * 128 + j, old = GRID(z->grid, i, j), color, diff;
+            struct RGBColor rgb = pixelToRGB(z->pixels[(127 - i) * 128 + j]);
+
+            if(old == GRID_EMPTY) {
+                changed[p] = 0;
+                continue;
+            }
+            if(z->reordered || map[old] == -1 || moved[old]) {
+                color = nearestColorIndex(rgb, key, n, &diff);
+                z->rematched++;
+            }
+            else {
+                color = map[old];
+                diff = z->distances[p];
+                for(k = 0 ; k < fresh ; k++) {
+                    int d = getDiff(rgb, key[freshColors[k]]);
+                    if(d < diff || (d == diff && freshColors[k] < color)) {
+                        diff = d;
+                        color = freshColors[k];
+                    }
+                }
+                z->checked++;
+            }
+
+            changed[p] = color != map[old];
+            changes += changed[p];
+            GRID(z->grid, i, j) = color;
+            z->distances[p] = diff;
+        }
+
+    free(z->key);
+    freeColorNames(z->names);
+    z->key = key;
+    z->names = names;
+    z->colors = n;
+    free(freshColors);
+    free(moved);
+    free(kept);
+    return changes;
+}
+
+int regionDirty(int *sums, int width, int row, int col, int size) { /* sums is a summed area table of the changed pixels, one wider and taller than the grid. */
+    int stride = width + 1;
+    return sums[(row + size) * stride + col + size] - sums[row * stride + col + size] - sums[(row + size) * stride + col] + sums[row * stride + col] > 0;
+}
+
+void remapQuad(struct Quad *q, int *map) {
+    int i;
+    if(q->color != GRID_EMPTY)
+        q->color = map[q->color];
+    if(q->leaf)
+        return;
+    for(i = 0 ; i < 4 ; i++)
+        remapQuad(q->children[i], map);
+}
+
+int regionMajority(struct Grid *grid, int colors, int row, int col, int size, int *error) {
+    int i, j, color = 0, total = 0, *counts = calloc(colors, sizeof(int));
+
+    for(i = row ; i < row + size ; i++)
+        for(j = col ; j < col + size ; j++)
+            if(GRID(grid, i, j) != GRID_EMPTY) {
+                counts[GRID(grid, i, j)]++;
+                total++;
+            }
+    for(i = 1 ; i < colors ; i++) /* Ties go to the lower index, same as majorityColor. */
+        if(counts[i] > counts[color])
+            color = i;
+    *error = total - counts[color];
+    if(counts[color] == 0)
+        color = GRID_EMPTY;
+
+    free(counts);
+    return color;
+}
+
+int updateQuad(struct Quad *q, struct Grid *grid, int colors, int *map, int *dirtySums) {
+    /* Recounts the quads over changed pixels and renumbers the rest. A NULL dirtySums recounts everything. Returns how many quads were recounted. */
+    int i, recounted = 1;
+
+    if(dirtySums != NULL && !regionDirty(dirtySums, grid->width, q->row, q->col, q->size)) {
+        remapQuad(q, map);
+        return 0;
+    }
+    if(q->leaf) {
+        q->color = GRID(grid, q->row, q->col);
+        q->error = 0;
+        return 1;
+    }
+
+    for(i = 0 ; i < 4 ; i++)
+        recounted += updateQuad(q->children[i], grid, colors, map, dirtySums);
+    q->color = regionMajority(grid, colors, q->row, q->col, q->size, &q->error);
+    return recounted;
+}
+
+void quadTarget(struct Quad *q, int detail, struct Grid *target) { /* Imprints what the quad looks like at the level of detail. */
+    struct LinkedList plan = {NULL, NULL};
+    quad(q, &plan, NULL, detail, 0);
+    imprintGrid(&plan, target);
+    freeQueue(&plan);
+}
+
+void requantizeMode(char *image, char *key, char *editedKey, int detail) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r"), *editedColorKey = fopen(editedKey, "r");
+    struct LinkedList plan = {NULL, NULL};
+    struct Quantization *z;
+    struct Quad q, fresh;
+    struct Grid *oldTarget, *newTarget, *check;
+    int i, j, n, changes, recounted, *map, *sums;
+    uint8_t *changed;
+    uint32_t *pixels, *pixelKey;
+    DWORD start;
+
+    if(fr == NULL || colorKey == NULL || editedColorKey == NULL) {
+        printf("Requantize mode could not open %s, %s or %s.\n", image, key, editedKey);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        if(editedColorKey != NULL)
+            fclose(editedColorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key) || !colorKeyFits(editedColorKey, editedKey)) {
+        fclose(fr);
+        fclose(colorKey);
+        fclose(editedColorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    pixels = malloc(128 * 128 * sizeof(uint32_t));
+    readPixels(fr, pixels);
+    z = allocQuantization(pixels, getKeyColors(colorKey, n), getColorNames(colorKey, n), n);
+    q = buildQuadExact(z->grid, n, 128);
+    oldTarget = allocGrid(128, 128);
+    newTarget = allocGrid(128, 128);
+    check = allocGrid(128, 128);
+    quadTarget(&q, detail, oldTarget);
+
+    map = malloc(n * sizeof(int));
+    changed = malloc(128 * 128);
+    sums = calloc(129 * 129, sizeof(int));
+    n = amountOfColors(editedColorKey);
+    pixelKey = getPixelKey(editedColorKey, n);
+
+    start = GetTickCount();
+    changes = requantize(z, getKeyColors(editedColorKey, n), getColorNames(editedColorKey, n), n, map, changed);
+    for(i = 0 ; i < 128 ; i++)
+        for(j = 0 ; j < 128 ; j++)
+            sums[(i + 1) * 129 + j + 1] = changed[i * 128 + j] + sums[i * 129 + j + 1] + sums[(i + 1) * 129 + j] - sums[i * 129 + j];
+    recounted = updateQuad(&q, z->grid, n, map, z->reordered ? NULL:sums);
+    printf("Requantized in %lu ms: %i pixels matched again, %i only checked against new colors, %i changed blocks, %i quads recounted.\n",
+        (unsigned long)(GetTickCount() - start), z->rematched, z->checked, changes, recounted);
+
+    for(i = 0 ; i < 128 ; i++) /* The old map with its colors numbered the way the edited key numbers them. */
+        for(j = 0 ; j < 128 ; j++)
+            if(GRID(oldTarget, i, j) != GRID_EMPTY)
+                GRID(oldTarget, i, j) = map[GRID(oldTarget, i, j)] < 0 ? GRID_EMPTY:map[GRID(oldTarget, i, j)];
+    quadTarget(&q, detail, newTarget);
+    deltaCommands(oldTarget, newTarget, &plan);
+    printf("Delta commands: %i\n", queueLength(&plan));
+
+    quantizePixels(pixels, z->key, n, check, NULL, NULL); /* Making sure the edit gives the same map as starting over with the edited key. */
+    if(!gridsMatch(check, z->grid))
+        printf("ERROR: The requantized grid does not match a full quantization.\n");
+    fresh = buildQuadExact(check, n, 128);
+    quadTarget(&fresh, detail, check);
+    if(!gridsMatch(check, newTarget))
+        printf("ERROR: The updated quad does not match a rebuilt quad.\n");
+
+    writeCommands(&plan, z->names, pixelKey);
+    destroyQuad(&q);
+    destroyQuad(&fresh);
+    freeQuantization(z);
+    freeGrid(oldTarget);
+    freeGrid(newTarget);
+    freeGrid(check);
+    free(map);
+    free(changed);
+    free(sums);
+    free(pixels);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+    fclose(editedColorKey);
+}
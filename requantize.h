@@ -0,0 +1,38 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: requantize.h
+
+Timeline:
+20261019 - File created.
+20261019 - quadTarget is declared here for the edit session.
+*/
+
+#ifndef REQUANTIZE_H
+#define REQUANTIZE_H
+
+#include <stdint.h>
+#include "bmp.h"
+#include "grid.h"
+#include "quad.h"
+
+struct Quantization { /* A quantized image that remembers how close every pixel got to its color, so an edited key can be matched again cheaply. */
+    int colors;
+    struct RGBColor *key; /* Owned by the quantization, replaced on every edit. */
+    char **names;
+    uint32_t *pixels; /* Bottom up, the way they are read from the bmp. */
+    struct Grid *grid;
+    int *distances; /* distances[row * width + col] is getDiff from the pixel to its color. */
+    int reordered; /* Set when the last edit moved colors that were kept past each other, which changes how ties are broken. */
+    int rematched; /* Pixels matched against the whole key by the last edit. */
+    int checked; /* Pixels only compared against the new and moved colors by the last edit. */
+};
+
+struct Quantization* allocQuantization(uint32_t *pixels, struct RGBColor *key, char **names, int n);
+void freeQuantization(struct Quantization *z);
+int requantize(struct Quantization *z, struct RGBColor *key, char **names, int n, int *map, uint8_t *changed);
+int updateQuad(struct Quad *q, struct Grid *grid, int colors, int *map, int *dirtySums);
+void quadTarget(struct Quad *q, int detail, struct Grid *target);
+void requantizeMode(char *image, char *key, char *editedKey, int detail);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: search.c
+
+Note: The amount of commands the optimizer makes depends a lot on the order the colors are extracted in.
+optimizeCommands uses one order from prioritizeMarkers. The search tries several orders across all cores and keeps the plan with the least commands.
+The first orders tried are the heuristic order, the heuristic reversed, and largest area first. Every order is tried horizontally and transposed (vertically first).
+After that a beam search starts from the best of those. At every position of the order it tries pulling one of the next few colors forward,
+and keeps the best few orders for the next position.
+The search stops handing out new orders once the time budget is used up. The heuristic order always runs, so there is always a plan.
+
+Timeline:
+20261019 - File created.
+20261019 - Uses the new contiguous grid.
+20261019 - Orders are scored on shared bitboards, only the best order makes a plan.
+20261019 - The best order's plan is made with the parallel extraction.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "search.h"
+#include "commands.h"
+#include "palette.h"
+#include "parallel.h"
+#include "bitboard.h"
+
+struct SearchCandidate {
+    int *order;
+    int transposed;
+    int commands; /* -1 when the candidate was skipped because the time ran out. */
+};
+
+struct Search {
+    struct Bitboard *boards[2]; /* Horizontal and transposed. */
+    int n;
+    int detail;
+    DWORD start;
+    DWORD budget;
+    struct SearchCandidate *candidates;
+};
+
+void searchCandidate(void *context, int job) {
+    struct Search *s = context;
+    struct SearchCandidate *c = &s->candidates[job];
+
+    if(job > 0 && GetTickCount() - s->start > s->budget) { /* The first candidate always runs. */
+        c->commands = -1;
+        return;
+    }
+
+    c->commands = bitboardCommands(s->boards[c->transposed], c->order, s->n, NULL); /* Only counting, the plan is made once the best order is known. */
+}
+
+void setCandidate(struct SearchCandidate *c, int *order, int n, int transposed) {
+    c->order = malloc(n * sizeof(int));
+    memcpy(c->order, order, n * sizeof(int));
+    c->transposed = transposed;
+    c->commands = -1;
+}
+
+void keepBest(struct SearchCandidate *best, struct SearchCandidate *c, int n) {
+    if(c->commands < 0 || (best->commands >= 0 && c->commands >= best->commands))
+        return;
+    memcpy(best->order, c->order, n * sizeof(int));
+    best->transposed = c->transposed;
+    best->commands = c->commands;
+}
+
+void areaOrder(struct Bitboard *b, int *order, int n) { /* Largest area first, so the background is placed before what sits on it. */
+    int i, j, *area = malloc(b->colors * sizeof(int));
+
+    for(i = 0 ; i < b->colors ; i++)
+        area[i] = bitboardArea(b, i);
+
+    for(i = 1 ; i < n ; i++) { /* Insertion sort, there are only ever a few dozen colors. */
+        int c = order[i];
+        for(j = i - 1 ; j >= 0 && area[order[j]] < area[c] ; j--)
+            order[j + 1] = order[j];
+        order[j + 1] = c;
+    }
+    free(area);
+}
+
+int searchCommands(struct LinkedList *queue, int colors, int detail, int budget) {
+    struct Search s;
+    struct SearchCandidate best, beam[SEARCH_BEAM_WIDTH], first[6];
+    int i, j, k, p, n, beamSize = 1, tried = 0, *order = malloc(colors * sizeof(int)), *work = malloc(colors * sizeof(int));
+    struct Grid *grid = allocGrid(128, 128);
+
+    imprintGrid(queue, grid);
+    s.boards[0] = allocBitboard(grid, colors, detail, 0);
+    s.boards[1] = allocBitboard(grid, colors, detail, 1);
+    s.detail = detail;
+    s.start = GetTickCount();
+    s.budget = budget;
+    s.n = n = bitboardOrder(s.boards[0], order);
+
+    /* The first round: heuristic, reversed heuristic and largest area first, each horizontal and transposed. */
+    for(i = 0 ; i < n ; i++)
+        work[i] = order[n - 1 - i];
+    setCandidate(&first[0], order, n, 0);
+    setCandidate(&first[1], order, n, 1);
+    setCandidate(&first[2], work, n, 0);
+    setCandidate(&first[3], work, n, 1);
+    memcpy(work, order, n * sizeof(int));
+    areaOrder(s.boards[0], work, n);
+    setCandidate(&first[4], work, n, 0);
+    setCandidate(&first[5], work, n, 1);
+
+    s.candidates = first;
+    parallelFor(6, searchCandidate, &s);
+
+    setCandidate(&best, order, n, 0);
+    for(i = 0 ; i < 6 ; i++) {
+        if(first[i].commands >= 0)
+            tried++;
+        keepBest(&best, &first[i], n);
+    }
+
+    setCandidate(&beam[0], best.order, n, best.transposed); /* The beam search starts from the best of the first round, in its direction. */
+    beam[0].commands = best.commands;
+
+    for(p = 0 ; p < n - 1 && GetTickCount() - s.start <= s.budget ; p++) {
+        struct SearchCandidate *step = malloc(beamSize * SEARCH_BEAM_REACH * sizeof(struct SearchCandidate));
+        int steps = 0;
+
+        for(i = 0 ; i < beamSize ; i++) {
+            for(k = 1 ; k <= SEARCH_BEAM_REACH && p + k < n ; k++) { /* Pull the color k places down to position p. */
+                memcpy(work, beam[i].order, n * sizeof(int));
+                for(j = p + k ; j > p ; j--)
+                    work[j] = work[j - 1];
+                work[p] = beam[i].order[p + k];
+                setCandidate(&step[steps++], work, n, beam[i].transposed);
+            }
+        }
+
+        s.candidates = step;
+        parallelFor(steps, searchCandidate, &s);
+
+        for(i = 0 ; i < steps ; i++) { /* A beam entry is only replaced by something that beats it. */
+            struct SearchCandidate *worst = NULL;
+            if(step[i].commands < 0)
+                continue;
+            tried++;
+            keepBest(&best, &step[i], n);
+            if(beamSize < SEARCH_BEAM_WIDTH) {
+                beam[beamSize++] = step[i];
+                step[i].order = NULL;
+                continue;
+            }
+            for(j = 0 ; j < beamSize ; j++)
+                if(worst == NULL || beam[j].commands > worst->commands)
+                    worst = &beam[j];
+            if(step[i].commands < worst->commands) {
+                free(worst->order);
+                *worst = step[i];
+                step[i].order = NULL;
+            }
+        }
+
+        for(i = 0 ; i < steps ; i++)
+            free(step[i].order);
+        free(step);
+    }
+
+    printf("Search tried %i orders in %lu ms. Heuristic: %i commands, best: %i commands%s.\n", tried, (unsigned long)(GetTickCount() - s.start), first[0].commands, best.commands, best.transposed ? " (transposed)":"");
+
+    freeQueue(queue);
+    bitboardCommandsParallel(s.boards[best.transposed], best.order, n, queue);
+
+    for(i = 0 ; i < 6 ; i++)
+        free(first[i].order);
+    for(i = 0 ; i < beamSize ; i++)
+        free(beam[i].order);
+    free(best.order);
+    freeBitboard(s.boards[0]);
+    freeBitboard(s.boards[1]);
+    freeGrid(grid);
+    free(order);
+    free(work);
+    return queueLength(queue);
+}
+
+void searchMode(char *image, char *key, int detail, int budget) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r");
+    struct LinkedList plan = {NULL, NULL};
+    struct Quad q;
+    int n;
+    struct Grid *grid, *original, *optimized;
+    char **colors;
+    uint32_t *pixelKey;
+
+    if(fr == NULL || colorKey == NULL) {
+        printf("Search mode could not open %s or %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    grid = allocGrid(128, 128);
+    original = allocGrid(128, 128);
+    optimized = allocGrid(128, 128);
+
+    quantizeImage(fr, colorKey, grid, NULL);
+    q = buildQuadExact(grid, n, 128);
+    quad(&q, &plan, NULL, detail, 0);
+    imprintGrid(&plan, original);
+    searchCommands(&plan, n, detail, budget);
+    imprintGrid(&plan, optimized);
+    if(!gridsMatch(original, optimized))
+        printf("ERROR: The searched commands do not match the quad.\n");
+
+    writeCommands(&plan, colors, pixelKey);
+    destroyQuad(&q);
+    freeGrid(grid);
+    freeGrid(original);
+    freeGrid(optimized);
+    freeColorNames(colors);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+}
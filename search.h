@@ -0,0 +1,22 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: search.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "linkedList.h"
+
+#define SEARCH_BEAM_WIDTH 3 /* How many orders are kept between steps of the beam search. */
+#define SEARCH_BEAM_REACH 4 /* How far down the order a color may be pulled forward in one step. */
+#define SEARCH_DEFAULT_BUDGET 2000 /* Milliseconds. */
+
+int searchCommands(struct LinkedList *queue, int colors, int detail, int budget);
+void searchMode(char *image, char *key, int detail, int budget);
+
+#endif
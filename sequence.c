@@ -0,0 +1,197 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: sequence.c
+
+Note: Sequence mode makes one set of commands for every frame of an animation, one map per frame.
+The frames are read from a numbered series of bmps, for example "frames\frame%03i.bmp".
+The frames are split into runs of neighboring frames and each run is handed to its own thread.
+Inside a run, every frame goes straight from reading, to matching colors, to commands, before the next frame is read.
+Pixels that are the same as the previous frame keep the color that frame already matched.
+With delta turned on, every frame after the first only gets the commands that turn the previous frame into it.
+The first frame of a run reads the frame before it as well, so each run can start on its own.
+
+Output is written to commands####.txt and pixelColors####.txt using the frame number.
+
+Timeline:
+20261019 - File created.
+20261019 - Uses the new contiguous grid.
+20261019 - Above detail 1, delta compares what the frames place at that detail instead of their raw pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include <string.h>
+#include "sequence.h"
+#include "commands.h"
+#include "palette.h"
+#include "delta.h"
+#include "parallel.h"
+#include "requantize.h"
+
+struct Sequence {
+    char *pattern;
+    int first;
+    int count;
+    int runLength;
+    int detail;
+    int delta;
+    int n;
+    struct RGBColor *key;
+    char **colors;
+    uint32_t *pixelKey;
+    volatile LONG reused;
+    volatile LONG commands;
+    volatile LONG missing;
+};
+
+int readFrame(struct Sequence *s, int frame, uint32_t *pixels) {
+    char name[256];
+    FILE *fr;
+
+    snprintf(name, 256, s->pattern, frame);
+    fr = fopen(name, "rb");
+    if(fr == NULL) {
+        printf("Frame %s could not be opened.\n", name);
+        InterlockedIncrement(&s->missing);
+        return 0;
+    }
+
+    readPixels(fr, pixels);
+    fclose(fr);
+    return 1;
+}
+
+void planFrame(struct Sequence *s, int frame, struct Grid *grid, struct Grid *target, struct Grid *previousTarget) {
+    /* 'target' gets what the frame looks like at the level of detail, NULL at detail 1 where that is the grid itself.
+    A delta goes from what the previous frame placed to what this frame would place, never from raw pixels. */
+    struct LinkedList plan = {NULL, NULL};
+    char commandsName[64], pixelColorsName[64];
+    struct Quad q;
+
+    if(target == NULL && previousTarget != NULL)
+        deltaCommands(previousTarget, grid, &plan);
+    else {
+        q = buildQuadExact(grid, s->n, 128);
+        if(target != NULL)
+            quadTarget(&q, s->detail, target);
+        if(previousTarget != NULL)
+            deltaCommands(previousTarget, target, &plan);
+        else {
+            quad(&q, &plan, NULL, s->detail, 0);
+            optimizeCommands(&plan, s->n, s->detail);
+        }
+        destroyQuad(&q);
+    }
+
+    InterlockedExchangeAdd(&s->commands, queueLength(&plan));
+    sprintf(commandsName, "commands%04i.txt", frame);
+    sprintf(pixelColorsName, "pixelColors%04i.txt", frame);
+    writePlan(&plan, s->colors, s->pixelKey, commandsName, pixelColorsName);
+}
+
+void sequenceRun(void *context, int run) {
+    struct Sequence *s = context;
+    int frame = s->first + run * s->runLength, last = frame + s->runLength, havePrevious = 0;
+    struct Grid *grid = allocGrid(128, 128), *previousGrid = allocGrid(128, 128), *swapGrid;
+    struct Grid *target = NULL, *previousTarget = NULL; /* What the frames place when the detail is above 1. */
+    uint32_t *pixels = malloc(128 * 128 * sizeof(uint32_t)), *previousPixels = malloc(128 * 128 * sizeof(uint32_t)), *swapPixels;
+
+    if(last > s->first + s->count)
+        last = s->first + s->count;
+    if(s->delta && s->detail > 1) {
+        target = allocGrid(128, 128);
+        previousTarget = allocGrid(128, 128);
+    }
+
+    if(s->delta && frame > s->first && readFrame(s, frame - 1, previousPixels)) { /* Delta needs the frame before the run to start from. */
+        quantizePixels(previousPixels, s->key, s->n, previousGrid, NULL, NULL);
+        if(previousTarget != NULL) {
+            struct Quad q = buildQuadExact(previousGrid, s->n, 128);
+            quadTarget(&q, s->detail, previousTarget);
+            destroyQuad(&q);
+        }
+        havePrevious = 1;
+    }
+
+    for( ; frame < last ; frame++) {
+        if(!readFrame(s, frame, pixels)) {
+            havePrevious = 0;
+            continue;
+        }
+
+        InterlockedExchangeAdd(&s->reused, quantizePixels(pixels, s->key, s->n, grid, havePrevious ? previousPixels:NULL, previousGrid));
+        planFrame(s, frame, grid, target, !s->delta || !havePrevious ? NULL:previousTarget != NULL ? previousTarget:previousGrid);
+
+        swapGrid = previousGrid; /* This frame becomes the previous frame of the next one. */
+        previousGrid = grid;
+        grid = swapGrid;
+        swapPixels = previousPixels;
+        previousPixels = pixels;
+        pixels = swapPixels;
+        swapGrid = previousTarget;
+        previousTarget = target;
+        target = swapGrid;
+        havePrevious = 1;
+    }
+
+    freeGrid(grid);
+    freeGrid(previousGrid);
+    if(target != NULL) {
+        freeGrid(target);
+        freeGrid(previousTarget);
+    }
+    free(pixels);
+    free(previousPixels);
+}
+
+void sequenceMode(char *pattern, int first, int count, char *key, int detail, int delta) {
+    FILE *colorKey = fopen(key, "r");
+    struct Sequence s;
+    int runs, threads = parallelThreads();
+    DWORD start = GetTickCount();
+
+    if(colorKey == NULL) {
+        printf("Sequence mode could not open %s.\n", key);
+        return;
+    }
+    if(count < 1 || detail < 1) {
+        printf("Sequence mode needs at least one frame and a detail of at least 1.\n");
+        fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(colorKey);
+        return;
+    }
+
+    s.pattern = pattern;
+    s.first = first;
+    s.count = count;
+    s.detail = detail;
+    s.delta = delta;
+    s.n = amountOfColors(colorKey);
+    s.key = getKeyColors(colorKey, s.n);
+    s.colors = getColorNames(colorKey, s.n);
+    s.pixelKey = getPixelKey(colorKey, s.n);
+    s.reused = 0;
+    s.commands = 0;
+    s.missing = 0;
+
+    /* Two runs per thread keeps the threads busy if some runs finish early, while runs stay long enough to reuse colors. */
+    s.runLength = (count + 2 * threads - 1) / (2 * threads);
+    runs = (count + s.runLength - 1) / s.runLength;
+
+    parallelFor(runs, sequenceRun, &s);
+
+    printf("Frames: %i, missing: %i, commands: %li\n", count, (int)s.missing, (long)s.commands);
+    printf("Reused %.1f%% of pixels from the previous frame.\n", s.reused * 100.0 / (count * 128.0 * 128.0));
+    printf("Finished in %lu ms.\n", (unsigned long)(GetTickCount() - start));
+
+    freeColorNames(s.colors);
+    free(s.key);
+    free(s.pixelKey);
+    fclose(colorKey);
+}
@@ -0,0 +1,15 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: sequence.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+void sequenceMode(char *pattern, int first, int count, char *key, int detail, int delta);
+
+#endif
@@ -0,0 +1,47 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: session.h
+
+Timeline:
+20261019 - File created.
+20261019 - SESSION_TILE counts cells of the level of detail instead of pixels.
+*/
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include "grid.h"
+#include "quad.h"
+#include "linkedList.h"
+
+#define SESSION_TILE 32 /* Cells of the level of detail across the part of a map that is planned on its own. A power of two. */
+
+struct EditSession { /* A wall being edited, kept ready so one pixel changing only redoes what that pixel touches. */
+    int colors;
+    int detail;
+    int columns; /* Maps across. */
+    int rows; /* Maps down. */
+    int tile; /* Pixels across a tile, SESSION_TILE cells of the detail but never more than a map. */
+    int tilesAcross; /* Tiles across the whole wall. */
+    int tilesDown;
+    struct Grid *grid; /* The wall, padded out to whole maps with GRID_EMPTY. */
+    struct Grid *target; /* What the quads look like at the level of detail. */
+    struct Quad *quads; /* By map, left to right then top to bottom. */
+    struct QuadCounts **counts; /* By map, kept so an edit only changes the counts above it. */
+    struct LinkedList *plans; /* By tile, in coordinates within the tile's map. */
+    uint8_t *dirty; /* By tile, set when its target changed since it was planned. */
+    int *dirtyTiles;
+    int dirtyCount;
+    int *order;
+};
+
+struct EditSession* allocEditSession(struct Grid *grid, int colors, int detail);
+int editPixels(struct EditSession *s, int row, int col, int height, int width, uint8_t color, int *replanned);
+void sessionPlan(struct EditSession *s, int map, struct LinkedList *plan);
+int sessionCommands(struct EditSession *s);
+void freeEditSession(struct EditSession *s);
+void editMode(char *image, char *key, int detail, char *edits, int map);
+
+#endif
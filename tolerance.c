@@ -0,0 +1,307 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: tolerance.c
+
+Note: The optimizer only ever fills a rectangle with one exact color, so two colors of the key that look the same still break up
+every rectangle they meet. Photos end up speckled with lone pixels of a neighboring shade, each costing commands for nothing.
+Before the bitboard runs, areas of one color (4 connected) are merged into a neighbor whose key color is at most the tolerance
+away by getDiff. Areas are merged smallest first. The smaller side of a merge takes the color of the bigger one, which is the
+choice with the least error over the two, and among the neighbors in tolerance the closest color wins.
+An area that was merged, or that something was merged into, is left alone after that, so a merged area never ends up an island
+of a color nothing around it has. Merging stops taking areas once the next one would go over the error budget, the getDiff
+between the old and new color summed over every pixel that changed.
+The validator compares the placed map with the exact one. Every wrong pixel has to be within the tolerance and all of them
+together within the budget.
+
+Timeline:
+20261019 - File created.
+20261019 - Tolerance mode stops when the image can not be read.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "tolerance.h"
+#include "bitboard.h"
+#include "commands.h"
+#include "palette.h"
+#include "quad.h"
+#include "requantize.h"
+
+struct Area { /* One 4 connected area of a single color. */
+    int color; /* What it is now, which is not what it was once merged. */
+    int size;
+    int top;
+    int left;
+    int bottom;
+    int right;
+    int done; /* Merged or merged into, either way it keeps its color from here on. */
+};
+
+struct AreaSize {
+    int size;
+    int area;
+};
+
+int compareAreaSize(const void *a, const void *b) {
+    const struct AreaSize *x = a, *y = b;
+    if(x->size != y->size)
+        return x->size - y->size;
+    return x->area - y->area;
+}
+
+int labelAreas(struct Grid *grid, int *labels, struct Area **areas) { /* Returns how many areas there are. GRID_EMPTY pixels get -1. */
+    int i, j, p, r, c, n = 0, capacity = 64, top, width = grid->width, total = grid->width * grid->height;
+    int *stack = malloc(total * sizeof(int));
+    struct Area *a;
+    uint8_t color;
+
+    *areas = malloc(capacity * sizeof(struct Area));
+    for(i = 0 ; i < total ; i++)
+        labels[i] = -1;
+
+    for(i = 0 ; i < grid->height ; i++)
+        for(j = 0 ; j < width ; j++) {
+            if(labels[i * width + j] >= 0 || (color = GRID(grid, i, j)) == GRID_EMPTY)
+                continue;
+            if(n == capacity) {
+                capacity *= 2;
+                *areas = realloc(*areas, capacity * sizeof(struct Area));
+            }
+            a = &(*areas)[n];
+            a->color = color;
+            a->size = 0;
+            a->top = a->bottom = i;
+            a->left = a->right = j;
+            a->done = 0;
+
+            labels[i * width + j] = n;
+            stack[0] = i * width + j;
+            top = 1;
+            while(top > 0) {
+                p = stack[--top];
+                r = p / width;
+                c = p % width;
+                a->size++;
+                a->top = r < a->top ? r:a->top;
+                a->bottom = r > a->bottom ? r:a->bottom;
+                a->left = c < a->left ? c:a->left;
+                a->right = c > a->right ? c:a->right;
+                if(r > 0 && labels[p - width] < 0 && GRID(grid, r - 1, c) == color) {
+                    labels[p - width] = n;
+                    stack[top++] = p - width;
+                }
+                if(r < grid->height - 1 && labels[p + width] < 0 && GRID(grid, r + 1, c) == color) {
+                    labels[p + width] = n;
+                    stack[top++] = p + width;
+                }
+                if(c > 0 && labels[p - 1] < 0 && GRID(grid, r, c - 1) == color) {
+                    labels[p - 1] = n;
+                    stack[top++] = p - 1;
+                }
+                if(c < width - 1 && labels[p + 1] < 0 && GRID(grid, r, c + 1) == color) {
+                    labels[p + 1] = n;
+                    stack[top++] = p + 1;
+                }
+            }
+            n++;
+        }
+
+    free(stack);
+    return n;
+}
+
+void touchNeighbor(struct Grid *grid, int *labels, struct Area *areas, int area, int r, int c, int *border) {
+    int l;
+    if(r < 0 || c < 0 || r >= grid->height || c >= grid->width)
+        return;
+    if((l = labels[r * grid->width + c]) >= 0 && l != area)
+        border[areas[l].color]++;
+}
+
+/*
+Merges areas of the grid into neighbors within 'tolerance' while the error stays within 'budget', see the note at the top.
+Returns how many areas were merged. 'report' can be NULL.
+*/
+int mergeNearColors(struct Grid *grid, struct RGBColor *key, int colors, int tolerance, long budget, struct MergeReport *report) {
+    int i, j, k, r, c, n, a, d, best, diff, any = 0, width = grid->width, merged = 0, pixels = 0;
+    int *labels, *border = malloc(colors * sizeof(int));
+    uint8_t *near = calloc(colors * colors, 1);
+    struct AreaSize *sizes;
+    struct Area *areas;
+    long error = 0, cost;
+
+    for(i = 0 ; i < colors ; i++)
+        for(j = 0 ; j < colors ; j++)
+            if(i != j && getDiff(key[i], key[j]) <= tolerance)
+                any = near[i * colors + j] = 1;
+    if(!any) { /* No two colors are close enough, so nothing can merge. */
+        free(near);
+        free(border);
+        if(report != NULL)
+            memset(report, 0, sizeof(struct MergeReport));
+        return 0;
+    }
+
+    labels = malloc(grid->width * grid->height * sizeof(int));
+    n = labelAreas(grid, labels, &areas);
+    sizes = malloc((n > 0 ? n:1) * sizeof(struct AreaSize));
+    for(i = 0 ; i < n ; i++) {
+        sizes[i].size = areas[i].size;
+        sizes[i].area = i;
+    }
+    qsort(sizes, n, sizeof(struct AreaSize), compareAreaSize);
+
+    for(k = 0 ; k < n ; k++) {
+        a = sizes[k].area;
+        if(areas[a].done)
+            continue;
+
+        memset(border, 0, colors * sizeof(int));
+        for(r = areas[a].top ; r <= areas[a].bottom ; r++)
+            for(c = areas[a].left ; c <= areas[a].right ; c++)
+                if(labels[r * width + c] == a) {
+                    touchNeighbor(grid, labels, areas, a, r - 1, c, border);
+                    touchNeighbor(grid, labels, areas, a, r + 1, c, border);
+                    touchNeighbor(grid, labels, areas, a, r, c - 1, border);
+                    touchNeighbor(grid, labels, areas, a, r, c + 1, border);
+                }
+
+        best = -1;
+        for(d = 0 ; d < colors ; d++) /* The closest color in tolerance, the longer border when two are as close. */
+            if(border[d] > 0 && near[areas[a].color * colors + d]) {
+                diff = getDiff(key[areas[a].color], key[d]);
+                if(best < 0 || diff < getDiff(key[areas[a].color], key[best]) || (diff == getDiff(key[areas[a].color], key[best]) && border[d] > border[best]))
+                    best = d;
+            }
+        if(best < 0)
+            continue;
+        cost = (long)areas[a].size * getDiff(key[areas[a].color], key[best]);
+        if(error + cost > budget)
+            continue;
+
+        for(r = areas[a].top ; r <= areas[a].bottom ; r++)
+            for(c = areas[a].left ; c <= areas[a].right ; c++)
+                if(labels[r * width + c] == a) {
+                    GRID(grid, r, c) = best;
+                    for(i = 0 ; i < 4 ; i++) { /* Whatever it merged into keeps its color from now on. */
+                        int nr = r + (i == 0) - (i == 1), nc = c + (i == 2) - (i == 3), l;
+                        if(nr >= 0 && nc >= 0 && nr < grid->height && nc < width && (l = labels[nr * width + nc]) >= 0 && areas[l].color == best)
+                            areas[l].done = 1;
+                    }
+                }
+        areas[a].color = best;
+        areas[a].done = 1;
+        error += cost;
+        pixels += areas[a].size;
+        merged++;
+    }
+
+    if(report != NULL) {
+        report->merged = merged;
+        report->pixels = pixels;
+        report->error = error;
+    }
+    free(labels);
+    free(areas);
+    free(sizes);
+    free(near);
+    free(border);
+    return merged;
+}
+
+void optimizeCommandsNear(struct LinkedList *queue, struct RGBColor *key, int colors, int detail, int tolerance, long budget, struct MergeReport *report) {
+    /* optimizeCommands, with near colors merged first. */
+    struct Grid *grid = allocGrid(128, 128);
+    struct Bitboard *b;
+    int n, *order = malloc(colors * sizeof(int));
+
+    imprintGrid(queue, grid);
+    freeQueue(queue);
+    mergeNearColors(grid, key, colors, tolerance, budget, report);
+    b = allocBitboard(grid, colors, detail, 0);
+    n = bitboardOrder(b, order);
+    bitboardCommandsParallel(b, order, n, queue);
+
+    freeBitboard(b);
+    freeGrid(grid);
+    free(order);
+}
+
+int toleranceErrors(struct Grid *expected, struct Grid *actual, struct RGBColor *key, int tolerance, long *error) {
+    /* Returns how many pixels are left unplaced or are further off than the tolerance. 'error' gets getDiff summed over every wrong pixel placed. */
+    int i, j, e, a, beyond = 0;
+    *error = 0;
+    for(i = 0 ; i < expected->height ; i++)
+        for(j = 0 ; j < expected->width ; j++) {
+            if((e = GRID(expected, i, j)) == GRID_EMPTY || (a = GRID(actual, i, j)) == e)
+                continue;
+            if(a == GRID_EMPTY) {
+                beyond++;
+                continue;
+            }
+            *error += getDiff(key[e], key[a]);
+            if(getDiff(key[e], key[a]) > tolerance)
+                beyond++;
+        }
+    return beyond;
+}
+
+void toleranceMode(char *image, char *key, int detail, int tolerance, long budget) {
+    FILE *fr = fopen(image, "rb");
+    struct LinkedList exact = {NULL, NULL}, near = {NULL, NULL};
+    struct MergeReport report;
+    struct BMPHeader h;
+    struct RGBColor *colors;
+    struct Grid *grid, *placed;
+    struct Quad q;
+    uint32_t *pixelKey;
+    char **names;
+    int n, beyond;
+    long error;
+
+    if(fr == NULL || (n = loadColorKey(key, &names, &colors, &pixelKey)) <= 0) {
+        printf("Tolerance mode could not open %s or the color key %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        return;
+    }
+    grid = allocGrid(128, 128);
+    h = readBMPHeader(fr);
+    if(!decodeQuantize(fr, &h, colors, n, grid, NULL)) {
+        printf("Tolerance mode could not read %s, it needs to be a 24 or 32 bit bmp.\n", image);
+        fclose(fr);
+        freeGrid(grid);
+        freeColorNames(names);
+        free(colors);
+        free(pixelKey);
+        return;
+    }
+    fclose(fr);
+    placed = allocGrid(128, 128);
+
+    q = buildQuadExact(grid, n, 128);
+    quad(&q, &exact, NULL, detail, 0);
+    cloneQueue(&exact, &near);
+    optimizeCommands(&exact, n, detail);
+    optimizeCommandsNear(&near, colors, n, detail, tolerance, budget, &report);
+    printf("%i commands exact, %i with colors within %i merged: %i areas, %i pixels changed.\n",
+        queueLength(&exact), queueLength(&near), tolerance, report.merged, report.pixels);
+
+    quadTarget(&q, detail, grid); /* What the exact plan places. */
+    imprintGrid(&near, placed);
+    beyond = toleranceErrors(grid, placed, colors, tolerance, &error);
+    if(beyond > 0 || error > budget || error != report.error)
+        printf("ERROR: %i pixels are further off than the tolerance, error %li of a budget of %li.\n", beyond, error, budget);
+    else
+        printf("Validator: every wrong pixel is within the tolerance, error %li of a budget of %li, %.2f a pixel.\n", error, budget, error / (128.0 * 128.0));
+
+    writeCommands(&near, names, pixelKey);
+    destroyQuad(&q);
+    freeQueue(&exact);
+    freeGrid(grid);
+    freeGrid(placed);
+    freeColorNames(names);
+    free(colors);
+    free(pixelKey);
+}
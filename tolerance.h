@@ -0,0 +1,31 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: tolerance.h
+
+Timeline:
+20261019 - File created.
+*/
+
+#ifndef TOLERANCE_H
+#define TOLERANCE_H
+
+#include "bmp.h"
+#include "grid.h"
+#include "linkedList.h"
+
+#define TOLERANCE_DEFAULT 48 /* Most getDiff two colors can be apart and still be merged, 16 a channel. */
+#define TOLERANCE_ERROR_BUDGET (128 * 128 * 4) /* Default getDiff summed over every merged pixel, 4 a pixel over the map. */
+
+struct MergeReport {
+    int merged; /* Areas that took the color of a neighbor. */
+    int pixels; /* Pixels that changed color. */
+    long error; /* getDiff between the old and new color, summed over those pixels. */
+};
+
+int mergeNearColors(struct Grid *grid, struct RGBColor *key, int colors, int tolerance, long budget, struct MergeReport *report);
+void optimizeCommandsNear(struct LinkedList *queue, struct RGBColor *key, int colors, int detail, int tolerance, long budget, struct MergeReport *report);
+int toleranceErrors(struct Grid *expected, struct Grid *actual, struct RGBColor *key, int tolerance, long *error);
+void toleranceMode(char *image, char *key, int detail, int tolerance, long budget);
+
+#endif
@@ -0,0 +1,182 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: tune.c
+
+Note: The auto tuner picks the level of detail instead of the user trying each one.
+Every level of detail (1, 2, 4, ... up to the size of the quad) is optimized at the same time on its own thread.
+Each level is scored by the amount of pixels that end up different from the quantized grid and by the amount of commands.
+The level with the least commands that stays within the error budget wins.
+If no level is within the budget, the level with the least errors wins.
+One level of detail for the whole map over-splits flat areas and under-splits detailed ones. Adaptive mode cuts the quad by error instead,
+using the error every quad keeps from buildQuadExact. With a global budget it keeps splitting whichever quad fixes the most pixels until the
+budget is met. Lone small quads break up the runs the bitboard merges, so the smallest quad allowed is tuned the same way as the level of detail:
+every power of two is tried on its own thread and the one with the least commands within the budget wins.
+With a per node budget a quad is placed whole once it gets no more than the budget wrong.
+
+Timeline:
+20261019 - File created.
+20261019 - Uses the new contiguous grid.
+20261019 - Added adaptiveCommands and the adaptive mode, compared against the best fixed level of detail.
+20261019 - The image is matched as it is read, without keeping its pixels.
+20261019 - Color keys with more colors than a grid holds are turned down.
+20261019 - autoTune only prints the levels it tried when asked to, so mimm.dll stays off stdout.
+*/
+
+#include <windows.h>
+#include <stdio.h>
+#include "tune.h"
+#include "commands.h"
+#include "parallel.h"
+#include "palette.h"
+
+struct TuneLevel {
+    struct LinkedList plan;
+    int detail;
+    int commands;
+    int errors;
+};
+
+struct TuneContext {
+    struct Quad *q;
+    struct Grid *grid;
+    int colors;
+    int adaptive; /* Set when each level is the smallest quad adaptiveQuad may place rather than a fixed level of detail. */
+    int budget;
+    struct TuneLevel *levels;
+};
+
+void tuneLevel(void *context, int job) {
+    struct TuneContext *t = context;
+    struct TuneLevel *level = &t->levels[job];
+    struct Grid *imprint = allocGrid(t->grid->width, t->grid->height);
+    int cell = level->detail;
+
+    level->plan.head = NULL;
+    level->plan.tail = NULL;
+    if(t->adaptive)
+        cell = adaptiveQuad(t->q, &level->plan, t->budget, level->detail);
+    else
+        quad(t->q, &level->plan, NULL, level->detail, 0);
+    optimizeCommands(&level->plan, t->colors, cell);
+    imprintGrid(&level->plan, imprint);
+
+    level->commands = queueLength(&level->plan);
+    level->errors = countMismatches(t->grid, imprint);
+    freeGrid(imprint);
+}
+
+int tuneLevels(struct Quad *q, struct Grid *grid, int colors, int adaptive, int budget, int verbose, struct LinkedList *plan) {
+    /* With verbose cleared nothing is printed, the library has no console to print to. */
+    int i, n = 0, best = -1, closest = 0;
+    struct TuneContext t;
+
+    for(i = 1 ; i <= q->size ; i *= 2) /* Levels of detail are the same powers of two offered in sizes.csv */
+        n++;
+
+    t.q = q;
+    t.grid = grid;
+    t.colors = colors;
+    t.adaptive = adaptive;
+    t.budget = budget;
+    t.levels = malloc(n * sizeof(struct TuneLevel));
+    for(i = 0 ; i < n ; i++)
+        t.levels[i].detail = 1 << i;
+
+    parallelFor(n, tuneLevel, &t);
+
+    for(i = 0 ; i < n ; i++) {
+        struct TuneLevel *level = &t.levels[i];
+        if(verbose)
+            printf("%s %i: %i commands, %i errors\n", adaptive ? "Adaptive down to":"Detail", level->detail, level->commands, level->errors);
+        if(level->errors <= budget && (best < 0 || level->commands < t.levels[best].commands))
+            best = i;
+        if(level->errors < t.levels[closest].errors)
+            closest = i;
+    }
+
+    if(best < 0) { /* Nothing fit in the budget, so settle for the most accurate level. */
+        if(verbose)
+            printf("No detail level is within the error budget of %i.\n", budget);
+        best = closest;
+    }
+
+    *plan = t.levels[best].plan;
+    for(i = 0 ; i < n ; i++)
+        if(i != best)
+            freeQueue(&t.levels[i].plan);
+
+    i = t.levels[best].detail;
+    if(verbose)
+        printf("%s selected detail %i.\n", adaptive ? "Adaptive":"Auto tune", i);
+    free(t.levels);
+    return i;
+}
+
+int autoTune(struct Quad *q, struct Grid *grid, int colors, int budget, int verbose, struct LinkedList *plan) {
+    return tuneLevels(q, grid, colors, 0, budget, verbose, plan);
+}
+
+int adaptiveCommands(struct Quad *q, struct Grid *grid, int colors, int budget, int perNode, struct LinkedList *plan) {
+    /* Cuts the quad by error and optimizes it. Returns the size of the smallest quad adaptiveQuad was allowed to place,
+    the 'limit' that gives the same quads again. With a per node budget that is 1. */
+    if(perNode) {
+        optimizeCommands(plan, colors, quadWithin(q, plan, budget));
+        return 1;
+    }
+    return tuneLevels(q, grid, colors, 1, budget, 1, plan);
+}
+
+void adaptiveMode(char *image, char *key, int budget, int perNode) {
+    FILE *fr = fopen(image, "rb"), *colorKey = fopen(key, "r");
+    struct LinkedList plan = {NULL, NULL}, fixed = {NULL, NULL};
+    struct Quad q;
+    struct Grid *grid, *imprint;
+    char **colors;
+    uint32_t *pixelKey;
+    int n, cell, detail, errors, fixedCommands;
+
+    if(fr == NULL || colorKey == NULL) {
+        printf("Adaptive mode could not open %s or %s.\n", image, key);
+        if(fr != NULL)
+            fclose(fr);
+        if(colorKey != NULL)
+            fclose(colorKey);
+        return;
+    }
+
+    if(!colorKeyFits(colorKey, key)) {
+        fclose(fr);
+        fclose(colorKey);
+        return;
+    }
+
+    n = amountOfColors(colorKey);
+    colors = getColorNames(colorKey, n);
+    pixelKey = getPixelKey(colorKey, n);
+    grid = allocGrid(128, 128);
+    imprint = allocGrid(128, 128);
+
+    quantizeImage(fr, colorKey, grid, NULL);
+    q = buildQuadExact(grid, n, 128);
+
+    cell = adaptiveCommands(&q, grid, n, budget, perNode, &plan);
+    imprintGrid(&plan, imprint);
+    errors = countMismatches(grid, imprint);
+
+    detail = autoTune(&q, grid, n, errors, 1, &fixed); /* The best a single level of detail can do with the same amount of errors. */
+    fixedCommands = queueLength(&fixed);
+    imprintGrid(&fixed, imprint);
+    printf("Adaptive (%s budget %i): %i commands, %i errors, smallest quad allowed %i. Best fixed detail %i: %i commands, %i errors.\n",
+        perNode ? "per node":"global", budget, queueLength(&plan), errors, cell, detail, fixedCommands, countMismatches(grid, imprint));
+
+    writeCommands(&plan, colors, pixelKey);
+    freeQueue(&fixed);
+    destroyQuad(&q);
+    freeGrid(grid);
+    freeGrid(imprint);
+    freeColorNames(colors);
+    free(pixelKey);
+    fclose(fr);
+    fclose(colorKey);
+}
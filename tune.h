@@ -0,0 +1,25 @@
+/*
+Author: Peter Gauld
+Project: Minecraft Map Image Maker.
+File: tune.h
+
+Timeline:
+20261019 - File created.
+20261019 - Added adaptiveCommands and adaptiveMode.
+20261019 - autoTune takes whether to print the levels it tried.
+*/
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include "linkedList.h"
+#include "quad.h"
+#include "grid.h"
+
+#define TUNE_ERROR_BUDGET 820 /* Default amount of wrong pixels allowed when auto tuning, roughly 5% of the map. */
+
+int autoTune(struct Quad *q, struct Grid *grid, int colors, int budget, int verbose, struct LinkedList *plan);
+int adaptiveCommands(struct Quad *q, struct Grid *grid, int colors, int budget, int perNode, struct LinkedList *plan);
+void adaptiveMode(char *image, char *key, int budget, int perNode);
+
+#endif